@@ -0,0 +1,476 @@
+//
+// HPACK header compression (RFC 7541).
+//
+
+#ifndef RESTPP_HPACK_HPP
+#define RESTPP_HPACK_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace restpp {
+
+class hpack_static_table {
+public:
+    static constexpr size_t size = 61;
+
+    // Index is 1-based, as on the wire.
+    static std::pair<std::string_view, std::string_view> get(size_t index) {
+        return entries()[index - 1];
+    }
+
+    // Returns the index of an exact match, or of a name-only match with
+    // name_only set, or 0.
+    static size_t find(std::string_view name, std::string_view value, bool& name_only) {
+        size_t name_match = 0;
+        for (size_t i = 0; i < size; ++i) {
+            const auto& [n, v] = entries()[i];
+            if (n == name) {
+                if (v == value) {
+                    name_only = false;
+                    return i + 1;
+                }
+                if (!name_match) {
+                    name_match = i + 1;
+                }
+            }
+        }
+        name_only = true;
+        return name_match;
+    }
+
+private:
+    using entry = std::pair<std::string_view, std::string_view>;
+
+    static const std::array<entry, size>& entries() {
+        static const std::array<entry, size> table{{
+            {":authority", ""},
+            {":method", "GET"},
+            {":method", "POST"},
+            {":path", "/"},
+            {":path", "/index.html"},
+            {":scheme", "http"},
+            {":scheme", "https"},
+            {":status", "200"},
+            {":status", "204"},
+            {":status", "206"},
+            {":status", "304"},
+            {":status", "400"},
+            {":status", "404"},
+            {":status", "500"},
+            {"accept-charset", ""},
+            {"accept-encoding", "gzip, deflate"},
+            {"accept-language", ""},
+            {"accept-ranges", ""},
+            {"accept", ""},
+            {"access-control-allow-origin", ""},
+            {"age", ""},
+            {"allow", ""},
+            {"authorization", ""},
+            {"cache-control", ""},
+            {"content-disposition", ""},
+            {"content-encoding", ""},
+            {"content-language", ""},
+            {"content-length", ""},
+            {"content-location", ""},
+            {"content-range", ""},
+            {"content-type", ""},
+            {"cookie", ""},
+            {"date", ""},
+            {"etag", ""},
+            {"expect", ""},
+            {"expires", ""},
+            {"from", ""},
+            {"host", ""},
+            {"if-match", ""},
+            {"if-modified-since", ""},
+            {"if-none-match", ""},
+            {"if-range", ""},
+            {"if-unmodified-since", ""},
+            {"last-modified", ""},
+            {"link", ""},
+            {"location", ""},
+            {"max-forwards", ""},
+            {"proxy-authenticate", ""},
+            {"proxy-authorization", ""},
+            {"range", ""},
+            {"referer", ""},
+            {"refresh", ""},
+            {"retry-after", ""},
+            {"server", ""},
+            {"set-cookie", ""},
+            {"strict-transport-security", ""},
+            {"transfer-encoding", ""},
+            {"user-agent", ""},
+            {"vary", ""},
+            {"via", ""},
+            {"www-authenticate", ""},
+        }};
+        return table;
+    }
+};
+
+// The HPACK Huffman code is canonical, so the code lengths are enough to
+// rebuild it; decoding walks one bit at a time over the per-length ranges.
+class hpack_huffman {
+    static constexpr unsigned max_length = 30;
+    static constexpr unsigned symbols = 257;
+    static constexpr unsigned eos = 256;
+public:
+    // Appends the decoded text to out.
+    static bool decode(std::string_view in, std::string& out) {
+        const auto& t = table();
+        uint32_t code = 0;
+        unsigned length = 0;
+        for (unsigned char byte: in) {
+            for (int bit = 7; bit >= 0; --bit) {
+                code = (code << 1) | ((byte >> bit) & 1u);
+                if (++length > max_length) {
+                    return false;
+                }
+                if (code - t.first[length] < t.count[length]) {
+                    auto symbol = t.sorted[t.offset[length] + code - t.first[length]];
+                    if (symbol == eos) {
+                        return false;
+                    }
+                    out.push_back(static_cast<char>(symbol));
+                    code = 0;
+                    length = 0;
+                }
+            }
+        }
+        // Padding is the most significant bits of EOS: at most 7 ones
+        return length <= 7 && code == (1u << length) - 1;
+    }
+
+private:
+    struct decode_table {
+        std::array<uint32_t, max_length + 1> first{};
+        std::array<uint32_t, max_length + 1> count{};
+        std::array<uint32_t, max_length + 1> offset{};
+        std::array<uint16_t, symbols> sorted{};
+    };
+
+    static const decode_table& table() {
+        static const decode_table t = build();
+        return t;
+    }
+
+    static decode_table build() {
+        static constexpr uint8_t lengths[symbols] = {
+            13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+            28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+            6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+            5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+            13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+            7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+            15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+            6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+            20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+            24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+            22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+            21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+            26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+            19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+            20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+            26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+            30,
+        };
+        decode_table t;
+        for (auto l: lengths) {
+            ++t.count[l];
+        }
+        uint32_t code = 0;
+        uint32_t offset = 0;
+        for (unsigned l = 1; l <= max_length; ++l) {
+            code = (code + t.count[l - 1]) << 1;
+            t.first[l] = code;
+            t.offset[l] = offset;
+            offset += t.count[l];
+        }
+        std::array<uint32_t, max_length + 1> next = t.offset;
+        for (unsigned s = 0; s < symbols; ++s) {
+            t.sorted[next[lengths[s]]++] = static_cast<uint16_t>(s);
+        }
+        return t;
+    }
+};
+
+// Dynamic table backed by one buffer allocated up front. Entries are laid out
+// as a ring inside twice the table size, so each one stays contiguous and can
+// be handed out as a view; inserting never allocates.
+class hpack_dynamic_table {
+    static constexpr size_t entry_overhead = 32;
+public:
+    explicit hpack_dynamic_table(size_t max_size = 4096)
+            : m_max{max_size}, m_limit{max_size},
+              m_data(2 * max_size), m_entries(max_size / entry_overhead + 1) {}
+
+    // Index is 0-based, newest first.
+    [[nodiscard]] bool get(size_t index, std::string_view& name, std::string_view& value) const {
+        if (index >= m_count) {
+            return false;
+        }
+        const auto& e = m_entries[(m_newest + m_entries.size() - index) % m_entries.size()];
+        name = std::string_view{m_data.data() + e.offset, e.name_length};
+        value = std::string_view{m_data.data() + e.offset + e.name_length, e.value_length};
+        return true;
+    }
+
+    void insert(std::string_view name, std::string_view value) {
+        auto needed = name.size() + value.size() + entry_overhead;
+        if (needed > m_limit) {
+            // Not an error: the table just ends up empty
+            clear();
+            return;
+        }
+        while (m_size + needed > m_limit) {
+            evict();
+        }
+        // One spare byte keeps every entry non-empty so offsets stay ordered
+        auto length = name.size() + value.size() + 1;
+        size_t offset = 0;
+        if (m_count > 0) {
+            const auto& newest = m_entries[m_newest];
+            const auto& oldest = m_entries[oldest_index()];
+            offset = newest.offset + newest.bytes();
+            if (newest.offset >= oldest.offset && offset + length > m_data.size()) {
+                offset = 0;
+            }
+        }
+        m_newest = (m_newest + 1) % m_entries.size();
+        auto& e = m_entries[m_newest];
+        e.offset = static_cast<uint32_t>(offset);
+        e.name_length = static_cast<uint32_t>(name.size());
+        e.value_length = static_cast<uint32_t>(value.size());
+        std::copy(name.begin(), name.end(), m_data.begin() + offset);
+        std::copy(value.begin(), value.end(), m_data.begin() + offset + name.size());
+        m_size += needed;
+        ++m_count;
+    }
+
+    bool resize(size_t limit) {
+        if (limit > m_max) {
+            return false;
+        }
+        m_limit = limit;
+        while (m_size > m_limit) {
+            evict();
+        }
+        return true;
+    }
+
+    void clear() {
+        m_count = 0;
+        m_size = 0;
+    }
+
+    [[nodiscard]] size_t count() const { return m_count; }
+    [[nodiscard]] size_t size() const { return m_size; }
+
+private:
+    struct entry {
+        uint32_t offset{0};
+        uint32_t name_length{0};
+        uint32_t value_length{0};
+
+        [[nodiscard]] size_t bytes() const { return name_length + value_length + 1; }
+    };
+
+    [[nodiscard]] size_t oldest_index() const {
+        return (m_newest + m_entries.size() - (m_count - 1)) % m_entries.size();
+    }
+
+    void evict() {
+        const auto& e = m_entries[oldest_index()];
+        m_size -= e.name_length + e.value_length + entry_overhead;
+        --m_count;
+    }
+
+    size_t m_max;
+    size_t m_limit;
+    size_t m_size{0};
+    size_t m_count{0};
+    size_t m_newest{0};
+    std::vector<char> m_data;
+    std::vector<entry> m_entries;
+};
+
+class hpack_decoder {
+public:
+    using header_handler = std::function<void(std::string_view name, std::string_view value)>;
+
+    explicit hpack_decoder(size_t max_table_size = 4096) : m_table{max_table_size} {}
+
+    // Decodes a complete header block. Views passed to on_header are only
+    // valid during the call. Returns false on a compression error, after
+    // which the decoder state can no longer be trusted.
+    bool decode(std::string_view block, const header_handler& on_header) {
+        while (!block.empty()) {
+            auto first = static_cast<unsigned char>(block.front());
+            uint64_t index;
+            if (first & 0x80) {
+                // Indexed header field
+                std::string_view name, value;
+                if (!decode_int(block, 7, index) || !lookup(index, name, value)) {
+                    return false;
+                }
+                on_header(name, value);
+            } else if (first & 0x40) {
+                // Literal with incremental indexing
+                std::string_view name, value;
+                if (!decode_int(block, 6, index) || !literal(block, index, name, value)) {
+                    return false;
+                }
+                if (index > hpack_static_table::size) {
+                    // The name lives in the table and may be evicted by the insert
+                    m_name.assign(name);
+                    name = m_name;
+                }
+                on_header(name, value);
+                m_table.insert(name, value);
+            } else if (first & 0x20) {
+                if (!decode_int(block, 5, index) || !m_table.resize(index)) {
+                    return false;
+                }
+            } else {
+                // Literal without indexing or never indexed
+                std::string_view name, value;
+                if (!decode_int(block, 4, index) || !literal(block, index, name, value)) {
+                    return false;
+                }
+                on_header(name, value);
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] const hpack_dynamic_table& table() const { return m_table; }
+
+private:
+    bool lookup(uint64_t index, std::string_view& name, std::string_view& value) const {
+        if (index == 0) {
+            return false;
+        }
+        if (index <= hpack_static_table::size) {
+            std::tie(name, value) = hpack_static_table::get(index);
+            return true;
+        }
+        return m_table.get(index - hpack_static_table::size - 1, name, value);
+    }
+
+    bool literal(std::string_view& in, uint64_t index, std::string_view& name, std::string_view& value) {
+        if (index) {
+            std::string_view ignored;
+            if (!lookup(index, name, ignored)) {
+                return false;
+            }
+        } else if (!decode_string(in, m_name, name)) {
+            return false;
+        }
+        return decode_string(in, m_value, value);
+    }
+
+    static bool decode_string(std::string_view& in, std::string& scratch, std::string_view& out) {
+        if (in.empty()) {
+            return false;
+        }
+        bool huffman = static_cast<unsigned char>(in.front()) & 0x80;
+        uint64_t length;
+        if (!decode_int(in, 7, length) || length > in.size()) {
+            return false;
+        }
+        auto raw = in.substr(0, length);
+        in.remove_prefix(length);
+        if (!huffman) {
+            out = raw;
+            return true;
+        }
+        scratch.clear();
+        if (!hpack_huffman::decode(raw, scratch)) {
+            return false;
+        }
+        out = scratch;
+        return true;
+    }
+
+    static bool decode_int(std::string_view& in, unsigned prefix_bits, uint64_t& value) {
+        if (in.empty()) {
+            return false;
+        }
+        uint64_t mask = (1u << prefix_bits) - 1;
+        value = static_cast<unsigned char>(in.front()) & mask;
+        in.remove_prefix(1);
+        if (value < mask) {
+            return true;
+        }
+        for (unsigned shift = 0; shift <= 28; shift += 7) {
+            if (in.empty()) {
+                return false;
+            }
+            auto byte = static_cast<unsigned char>(in.front());
+            in.remove_prefix(1);
+            value += uint64_t{byte & 0x7fu} << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    hpack_dynamic_table m_table;
+    std::string m_name;
+    std::string m_value;
+};
+
+// Stateless encoder: fields are emitted as static table references or as
+// literals that are never added to the peer's dynamic table, so there is no
+// table to keep in sync.
+class hpack_encoder {
+public:
+    static void encode(std::string& out, std::string_view name, std::string_view value) {
+        bool name_only;
+        auto index = hpack_static_table::find(name, value, name_only);
+        if (index && !name_only) {
+            encode_int(out, 0x80, 7, index);
+            return;
+        }
+        // Literal header field without indexing
+        encode_int(out, 0x00, 4, index);
+        if (!index) {
+            encode_string(out, name);
+        }
+        encode_string(out, value);
+    }
+
+private:
+    static void encode_string(std::string& out, std::string_view text) {
+        encode_int(out, 0x00, 7, text.size());
+        out.append(text);
+    }
+
+    static void encode_int(std::string& out, uint8_t flags, unsigned prefix_bits, uint64_t value) {
+        uint64_t mask = (1u << prefix_bits) - 1;
+        if (value < mask) {
+            out.push_back(static_cast<char>(flags | value));
+            return;
+        }
+        out.push_back(static_cast<char>(flags | mask));
+        value -= mask;
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+};
+
+}
+
+#endif //RESTPP_HPACK_HPP
@@ -5,7 +5,11 @@
 #ifndef RESTPP_HTTP_HPP
 #define RESTPP_HTTP_HPP
 
+#include <cctype>
+#include <cstdint>
+#include <string>
 #include <string_view>
+#include <optional>
 #include <map>
 #include <unordered_map>
 #include <utility>
@@ -88,6 +92,14 @@ public:
 
     explicit response(std::string text) : response(http_code::http_200_ok, std::move(text)) {}
 
+    // Responses that take over the connection (e.g. websocket upgrades)
+    // derive from this class.
+    virtual ~response() = default;
+    response(const response&) = default;
+    response(response&&) = default;
+    response& operator=(const response&) = default;
+    response& operator=(response&&) = default;
+
     [[nodiscard]] http_code code() const {
         return m_code;
     }
@@ -96,9 +108,17 @@ public:
     [[nodiscard]] const std::string& text() const { return m_text; }
     void text(std::string text) { m_text = std::move(text); }
 
+    void set_header(std::string name, std::string value) {
+        m_headers.emplace_back(std::move(name), std::move(value));
+    }
+    [[nodiscard]] const std::vector<std::pair<std::string, std::string>>& headers() const {
+        return m_headers;
+    }
+
 private:
     http_code m_code;
     std::string m_text;
+    std::vector<std::pair<std::string, std::string>> m_headers;
 };
 
 
@@ -158,6 +178,31 @@ public:
         return m_path_parts.empty();
     }
 private:
+    // Header names are case-insensitive, and HTTP/2 sends them lowercase
+    struct ihash {
+        size_t operator()(std::string_view text) const {
+            uint64_t h = 14695981039346656037ull;
+            for (unsigned char c: text) {
+                h = (h ^ static_cast<unsigned char>(std::tolower(c))) * 1099511628211ull;
+            }
+            return static_cast<size_t>(h);
+        }
+    };
+
+    struct iequal {
+        bool operator()(std::string_view a, std::string_view b) const {
+            if (a.size() != b.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
     void parse_text(std::string_view text) {
         auto lines = split(text, "\r\n");
         auto iter = lines.cbegin();
@@ -186,15 +231,22 @@ private:
         m_path_parts.insert(m_path_parts.begin(), url_parts.begin(), url_parts.end());
 
         // Parse all headers
-        while (iter != lines.end() && !(++iter)->empty()) {
+        while (iter != lines.end() && ++iter != lines.end() && !iter->empty()) {
             size_t sep_pos = iter->find(':');
+            if (sep_pos == std::string::npos) {
+                continue;
+            }
             size_t value_pos = iter->find_first_not_of(' ', sep_pos + 1);
-            m_headers[iter->substr(0, sep_pos)] = iter->substr(value_pos);
+            m_headers[iter->substr(0, sep_pos)] =
+                    value_pos == std::string::npos ? std::string_view{} : iter->substr(value_pos);
         }
 
-        // Finally, get body
+        // Finally, get body: everything after the blank line, CRLFs included
         if (iter != lines.end()) {
-            m_body = *++iter;
+            size_t body_pos = static_cast<size_t>(iter->data() - text.data()) + 2;
+            if (body_pos < text.size()) {
+                m_body = text.substr(body_pos);
+            }
         }
     }
 
@@ -255,7 +307,7 @@ private:
     std::deque<std::string_view> m_path_parts;
     std::unordered_map<std::string_view, std::string_view> m_arguments;
     std::unordered_map<std::string_view, std::string_view> m_get_variables;
-    std::unordered_map<std::string_view, std::string_view> m_headers;
+    std::unordered_map<std::string_view, std::string_view, ihash, iequal> m_headers;
 };
 
 }
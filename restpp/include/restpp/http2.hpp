@@ -0,0 +1,627 @@
+//
+// HTTP/2 over cleartext with prior knowledge (RFC 9113).
+//
+
+#ifndef RESTPP_HTTP2_HPP
+#define RESTPP_HTTP2_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "hpack.hpp"
+#include "restpp.hpp"
+
+namespace restpp {
+
+enum class h2_frame_type : uint8_t {
+    data = 0x0,
+    headers = 0x1,
+    priority = 0x2,
+    rst_stream = 0x3,
+    settings = 0x4,
+    push_promise = 0x5,
+    ping = 0x6,
+    goaway = 0x7,
+    window_update = 0x8,
+    continuation = 0x9,
+};
+
+enum class h2_error : uint32_t {
+    no_error = 0x0,
+    protocol_error = 0x1,
+    internal_error = 0x2,
+    flow_control_error = 0x3,
+    settings_timeout = 0x4,
+    stream_closed = 0x5,
+    frame_size_error = 0x6,
+    refused_stream = 0x7,
+    cancel = 0x8,
+    compression_error = 0x9,
+    connect_error = 0xa,
+    enhance_your_calm = 0xb,
+    inadequate_security = 0xc,
+    http_1_1_required = 0xd,
+};
+
+struct h2_frame {
+    static constexpr size_t header_size = 9;
+    static constexpr uint8_t end_stream = 0x1;
+    static constexpr uint8_t ack = 0x1;
+    static constexpr uint8_t end_headers = 0x4;
+    static constexpr uint8_t padded = 0x8;
+    static constexpr uint8_t priority = 0x20;
+
+    h2_frame_type type;
+    uint8_t flags;
+    uint32_t stream_id;
+    std::string_view payload;
+
+    // Parses one frame from the front of data; false if it is not complete.
+    static bool parse(std::string_view data, h2_frame& frame) {
+        if (data.size() < header_size) {
+            return false;
+        }
+        auto length = read_u24(data);
+        if (data.size() < header_size + length) {
+            return false;
+        }
+        frame.type = static_cast<h2_frame_type>(data[3]);
+        frame.flags = static_cast<uint8_t>(data[4]);
+        frame.stream_id = read_u32(data.substr(5)) & 0x7fffffffu;
+        frame.payload = data.substr(header_size, length);
+        return true;
+    }
+
+    static size_t pending_length(std::string_view data) {
+        return data.size() < header_size ? 0 : read_u24(data);
+    }
+
+    static void write(std::string& out, h2_frame_type type, uint8_t flags,
+                      uint32_t stream_id, std::string_view payload) {
+        write_u24(out, static_cast<uint32_t>(payload.size()));
+        out.push_back(static_cast<char>(type));
+        out.push_back(static_cast<char>(flags));
+        write_u32(out, stream_id & 0x7fffffffu);
+        out.append(payload);
+    }
+
+    static uint32_t read_u24(std::string_view p) {
+        return (uint32_t{static_cast<uint8_t>(p[0])} << 16)
+               | (uint32_t{static_cast<uint8_t>(p[1])} << 8)
+               | uint32_t{static_cast<uint8_t>(p[2])};
+    }
+
+    static uint32_t read_u32(std::string_view p) {
+        return (uint32_t{static_cast<uint8_t>(p[0])} << 24) | read_u24(p.substr(1));
+    }
+
+    static void write_u24(std::string& out, uint32_t value) {
+        out.push_back(static_cast<char>(value >> 16));
+        out.push_back(static_cast<char>(value >> 8));
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void write_u32(std::string& out, uint32_t value) {
+        out.push_back(static_cast<char>(value >> 24));
+        write_u24(out, value);
+    }
+};
+
+// Server side of one HTTP/2 connection. It does no I/O: bytes read from the
+// socket go into feed() and whatever output() holds is written back. Every
+// stream becomes a request routed through the endpoint tree.
+class h2_connection {
+    static constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    static constexpr uint32_t default_window = 65535;
+    static constexpr uint32_t max_frame_size = 16384;
+    static constexpr uint32_t max_streams = 100;
+    static constexpr uint32_t max_header_list_size = 65536;
+    static constexpr size_t max_body_size = 1 << 20;
+public:
+    explicit h2_connection(endpoint& root) : m_root{root} {
+        // Server preface: our SETTINGS
+        std::string settings;
+        add_setting(settings, 0x3, max_streams);
+        add_setting(settings, 0x5, max_frame_size);
+        add_setting(settings, 0x6, max_header_list_size);
+        h2_frame::write(m_out, h2_frame_type::settings, 0, 0, settings);
+    }
+
+    // Returns false once the connection is done; output() may still hold a
+    // GOAWAY to send before closing.
+    bool feed(std::string_view bytes) {
+        if (m_closed) {
+            return false;
+        }
+        m_in.append(bytes);
+        std::string_view data = m_in;
+        if (!m_preface_received) {
+            auto n = std::min(data.size(), preface.size());
+            if (data.substr(0, n) != preface.substr(0, n)) {
+                return fail(h2_error::protocol_error);
+            }
+            if (n < preface.size()) {
+                return true;
+            }
+            data.remove_prefix(preface.size());
+            m_preface_received = true;
+        }
+        h2_frame frame{};
+        while (!m_closed && h2_frame::parse(data, frame)) {
+            data.remove_prefix(h2_frame::header_size + frame.payload.size());
+            if (!handle_frame(frame)) {
+                break;
+            }
+        }
+        if (!m_closed && h2_frame::pending_length(data) > max_frame_size) {
+            fail(h2_error::frame_size_error);
+        }
+        m_in.erase(0, m_in.size() - data.size());
+        return !m_closed;
+    }
+
+    [[nodiscard]] const std::string& output() const { return m_out; }
+    void consume_output(size_t n) { m_out.erase(0, n); }
+    std::string take_output() { return std::exchange(m_out, {}); }
+
+    [[nodiscard]] bool closed() const { return m_closed; }
+    [[nodiscard]] size_t open_streams() const { return m_streams.size(); }
+
+private:
+    struct stream {
+        std::string method;
+        std::string path;
+        std::string authority;
+        std::string headers;
+        std::string body;
+        std::string pending;
+        size_t sent{0};
+        int64_t send_window{0};
+        bool end_stream{false};
+    };
+
+    bool handle_frame(const h2_frame& frame) {
+        if (frame.payload.size() > max_frame_size) {
+            return fail(h2_error::frame_size_error);
+        }
+        if (m_continuation_stream && frame.type != h2_frame_type::continuation) {
+            return fail(h2_error::protocol_error);
+        }
+        if (!m_settings_received && frame.type != h2_frame_type::settings) {
+            return fail(h2_error::protocol_error);
+        }
+        switch (frame.type) {
+            case h2_frame_type::settings:
+                return on_settings(frame);
+            case h2_frame_type::ping:
+                return on_ping(frame);
+            case h2_frame_type::headers:
+                return on_headers(frame);
+            case h2_frame_type::continuation:
+                return on_continuation(frame);
+            case h2_frame_type::data:
+                return on_data(frame);
+            case h2_frame_type::window_update:
+                return on_window_update(frame);
+            case h2_frame_type::rst_stream:
+                m_streams.erase(frame.stream_id);
+                return true;
+            case h2_frame_type::goaway:
+                m_closed = true;
+                return false;
+            case h2_frame_type::push_promise:
+                // Clients must not push
+                return fail(h2_error::protocol_error);
+            case h2_frame_type::priority:
+            default:
+                return true;
+        }
+    }
+
+    bool on_settings(const h2_frame& frame) {
+        if (frame.stream_id != 0) {
+            return fail(h2_error::protocol_error);
+        }
+        if (frame.flags & h2_frame::ack) {
+            return true;
+        }
+        if (frame.payload.size() % 6 != 0) {
+            return fail(h2_error::frame_size_error);
+        }
+        for (auto p = frame.payload; !p.empty(); p.remove_prefix(6)) {
+            auto id = static_cast<uint16_t>((static_cast<uint8_t>(p[0]) << 8) | static_cast<uint8_t>(p[1]));
+            auto value = h2_frame::read_u32(p.substr(2));
+            if (id == 0x4) {
+                // INITIAL_WINDOW_SIZE applies retroactively to open streams
+                if (value > 0x7fffffffu) {
+                    return fail(h2_error::flow_control_error);
+                }
+                for (auto& [_, s]: m_streams) {
+                    s.send_window += int64_t{value} - m_peer_initial_window;
+                }
+                m_peer_initial_window = value;
+            } else if (id == 0x5) {
+                if (value < 16384 || value > 16777215) {
+                    return fail(h2_error::protocol_error);
+                }
+                m_peer_max_frame = value;
+            }
+        }
+        m_settings_received = true;
+        h2_frame::write(m_out, h2_frame_type::settings, h2_frame::ack, 0, {});
+        flush();
+        return true;
+    }
+
+    bool on_ping(const h2_frame& frame) {
+        if (frame.stream_id != 0 || frame.payload.size() != 8) {
+            return fail(frame.stream_id ? h2_error::protocol_error : h2_error::frame_size_error);
+        }
+        if (!(frame.flags & h2_frame::ack)) {
+            h2_frame::write(m_out, h2_frame_type::ping, h2_frame::ack, 0, frame.payload);
+        }
+        return true;
+    }
+
+    bool on_headers(const h2_frame& frame) {
+        auto id = frame.stream_id;
+        if (id == 0 || id % 2 == 0) {
+            return fail(h2_error::protocol_error);
+        }
+        auto block = frame.payload;
+        if (!strip_padding(frame, block)) {
+            return fail(h2_error::protocol_error);
+        }
+        if (frame.flags & h2_frame::priority) {
+            if (block.size() < 5) {
+                return fail(h2_error::frame_size_error);
+            }
+            block.remove_prefix(5);
+        }
+        if (block.size() > max_header_list_size) {
+            return fail(h2_error::enhance_your_calm);
+        }
+
+        auto it = m_streams.find(id);
+        if (it == m_streams.end()) {
+            if (id <= m_last_stream) {
+                return fail(h2_error::stream_closed);
+            }
+            m_last_stream = id;
+            if (m_streams.size() >= max_streams) {
+                // Still decode the block to keep the HPACK state in sync
+                m_header_block.assign(block);
+                reset_stream(id, h2_error::refused_stream);
+                return continue_headers(frame, 0);
+            }
+            it = m_streams.emplace(id, stream{}).first;
+            it->second.send_window = m_peer_initial_window;
+        } else if (it->second.end_stream) {
+            return fail(h2_error::stream_closed);
+        }
+        it->second.end_stream = frame.flags & h2_frame::end_stream;
+        m_header_block.assign(block);
+        return continue_headers(frame, id);
+    }
+
+    bool on_continuation(const h2_frame& frame) {
+        if (!m_continuation_stream || frame.stream_id != m_continuation_id) {
+            return fail(h2_error::protocol_error);
+        }
+        // The block cannot be skipped without desyncing HPACK, so an endless
+        // run of CONTINUATION frames ends the connection.
+        if (m_header_block.size() + frame.payload.size() > max_header_list_size) {
+            return fail(h2_error::enhance_your_calm);
+        }
+        m_header_block.append(frame.payload);
+        return continue_headers(frame, m_continuation_stream);
+    }
+
+    // stream_id is 0 when the block must be decoded and discarded.
+    bool continue_headers(const h2_frame& frame, uint32_t stream_id) {
+        if (!(frame.flags & h2_frame::end_headers)) {
+            m_continuation_stream = stream_id ? stream_id : UINT32_MAX;
+            m_continuation_id = frame.stream_id;
+            return true;
+        }
+        m_continuation_stream = 0;
+        auto it = m_streams.find(stream_id);
+        stream* s = it != m_streams.end() ? &it->second : nullptr;
+        bool trailers = s && !s->method.empty();
+        // Small blocks can still expand a lot through the dynamic table
+        size_t list_size = 0;
+        // Fields are copied into HTTP/1.1 text, so anything that could
+        // smuggle in a line break or extra request line is refused.
+        bool malformed = false;
+        bool regular_seen = false;
+        bool ok = m_decoder.decode(m_header_block, [&](std::string_view name, std::string_view value) {
+            if (!s || trailers || malformed) {
+                return;
+            }
+            list_size += name.size() + value.size() + 32;
+            if (list_size > max_header_list_size) {
+                return;
+            }
+            if (!valid_field(name, value)) {
+                malformed = true;
+            } else if (name.front() != ':') {
+                regular_seen = true;
+                if (connection_specific(name) || (name == "te" && value != "trailers")) {
+                    malformed = true;
+                } else {
+                    s->headers.append(name).append(": ").append(value).append("\r\n");
+                }
+            } else if (regular_seen) {
+                // Pseudo-headers must come first
+                malformed = true;
+            } else if (name == ":method") {
+                s->method = value;
+            } else if (name == ":path") {
+                s->path = value;
+            } else if (name == ":authority") {
+                s->authority = value;
+            } else if (name != ":scheme") {
+                malformed = true;
+            }
+        });
+        if (!ok) {
+            return fail(h2_error::compression_error);
+        }
+        if (!s) {
+            return true;
+        }
+        if (list_size > max_header_list_size) {
+            reject(stream_id, http_code::http_431_request_header_fields_too_large);
+            return true;
+        }
+        // Both end up in the request line
+        if (s->method.find_first_of(" \t") != std::string::npos
+            || s->path.find_first_of(" \t") != std::string::npos) {
+            malformed = true;
+        }
+        if (malformed || s->method.empty() || s->path.empty()) {
+            reset_stream(stream_id, h2_error::protocol_error);
+            return true;
+        }
+        if (s->end_stream) {
+            dispatch(stream_id, *s);
+        }
+        return true;
+    }
+
+    bool on_data(const h2_frame& frame) {
+        auto payload = frame.payload;
+        if (!strip_padding(frame, payload)) {
+            return fail(h2_error::protocol_error);
+        }
+        // Hand the whole frame back to the sender straight away
+        if (!frame.payload.empty()) {
+            window_update(0, static_cast<uint32_t>(frame.payload.size()));
+        }
+        auto it = m_streams.find(frame.stream_id);
+        if (it == m_streams.end() || it->second.end_stream) {
+            if (frame.stream_id == 0 || frame.stream_id > m_last_stream) {
+                return fail(h2_error::protocol_error);
+            }
+            reset_stream(frame.stream_id, h2_error::stream_closed);
+            return true;
+        }
+        auto& s = it->second;
+        if (s.body.size() + payload.size() > max_body_size) {
+            reject(frame.stream_id, http_code::http_413_content_too_large);
+            return true;
+        }
+        s.body.append(payload);
+        if (frame.flags & h2_frame::end_stream) {
+            s.end_stream = true;
+            dispatch(frame.stream_id, s);
+        } else if (!frame.payload.empty()) {
+            window_update(frame.stream_id, static_cast<uint32_t>(frame.payload.size()));
+        }
+        return true;
+    }
+
+    bool on_window_update(const h2_frame& frame) {
+        if (frame.payload.size() != 4) {
+            return fail(h2_error::frame_size_error);
+        }
+        auto increment = h2_frame::read_u32(frame.payload) & 0x7fffffffu;
+        if (frame.stream_id == 0) {
+            if (increment == 0 || m_send_window + increment > 0x7fffffff) {
+                return fail(increment ? h2_error::flow_control_error : h2_error::protocol_error);
+            }
+            m_send_window += increment;
+        } else if (auto it = m_streams.find(frame.stream_id); it != m_streams.end()) {
+            if (increment == 0 || it->second.send_window + increment > 0x7fffffff) {
+                reset_stream(frame.stream_id, increment ? h2_error::flow_control_error
+                                                        : h2_error::protocol_error);
+                return true;
+            }
+            it->second.send_window += increment;
+        }
+        flush();
+        return true;
+    }
+
+    void dispatch(uint32_t id, stream& s) {
+        // Rebuild the request as HTTP/1.1 text so it goes through the same
+        // parser and routing as every other request.
+        std::string text;
+        text.reserve(s.method.size() + s.path.size() + s.headers.size() + s.body.size() + 32);
+        text.append(s.method).append(" ").append(s.path).append(" HTTP/2\r\n");
+        if (!s.authority.empty()) {
+            text.append("Host: ").append(s.authority).append("\r\n");
+        }
+        text.append(s.headers).append("\r\n").append(s.body);
+
+        auto res = m_root.handle_request(std::make_shared<request>(text));
+        if (!res) {
+            res = std::make_shared<response>(http_code::http_500_internal_server_error, "");
+        } else if (static_cast<int>(res->code()) < 200) {
+            // Upgrades (101) and other interim answers have no h2 equivalent
+            res = std::make_shared<response>(http_code::http_501_not_implemented, "Not Implemented");
+        }
+
+        std::string block;
+        hpack_encoder::encode(block, ":status", std::to_string(static_cast<int>(res->code())));
+        hpack_encoder::encode(block, "content-length", std::to_string(res->text().size()));
+        for (const auto& [name, value]: res->headers()) {
+            // HTTP/2 field names are lowercase
+            std::string lower{name};
+            std::transform(lower.begin(), lower.end(), lower.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (!connection_specific(lower)) {
+                hpack_encoder::encode(block, lower, value);
+            }
+        }
+        auto flags = h2_frame::end_headers;
+        if (res->text().empty()) {
+            flags |= h2_frame::end_stream;
+        }
+        h2_frame::write(m_out, h2_frame_type::headers, flags, id, block);
+        if (res->text().empty()) {
+            m_streams.erase(id);
+            return;
+        }
+        s.pending = res->text();
+        s.sent = 0;
+        m_ready.push_back(id);
+        flush();
+    }
+
+    // Sends as much pending response data as the flow control windows allow.
+    void flush() {
+        for (size_t n = m_ready.size(); n > 0 && m_send_window > 0; --n) {
+            auto id = m_ready.front();
+            m_ready.pop_front();
+            auto it = m_streams.find(id);
+            if (it == m_streams.end()) {
+                continue;
+            }
+            auto& s = it->second;
+            while (s.sent < s.pending.size() && s.send_window > 0 && m_send_window > 0) {
+                auto chunk = std::min<int64_t>({static_cast<int64_t>(s.pending.size() - s.sent),
+                                                s.send_window, m_send_window, m_peer_max_frame});
+                auto last = s.sent + chunk == s.pending.size();
+                h2_frame::write(m_out, h2_frame_type::data, last ? h2_frame::end_stream : 0, id,
+                                std::string_view{s.pending}.substr(s.sent, chunk));
+                s.sent += chunk;
+                s.send_window -= chunk;
+                m_send_window -= chunk;
+            }
+            if (s.sent == s.pending.size()) {
+                m_streams.erase(it);
+            } else {
+                m_ready.push_back(id);
+            }
+        }
+    }
+
+    bool strip_padding(const h2_frame& frame, std::string_view& payload) const {
+        if (!(frame.flags & h2_frame::padded)) {
+            return true;
+        }
+        if (payload.empty()) {
+            return false;
+        }
+        auto pad = static_cast<uint8_t>(payload.front());
+        payload.remove_prefix(1);
+        if (pad > payload.size()) {
+            return false;
+        }
+        payload.remove_suffix(pad);
+        return true;
+    }
+
+    void window_update(uint32_t id, uint32_t increment) {
+        std::string payload;
+        h2_frame::write_u32(payload, increment);
+        h2_frame::write(m_out, h2_frame_type::window_update, 0, id, payload);
+    }
+
+    // Answers a request without reading the rest of it; the client learns from
+    // the NO_ERROR reset that it can stop sending.
+    void reject(uint32_t id, http_code code) {
+        std::string block;
+        hpack_encoder::encode(block, ":status", std::to_string(static_cast<int>(code)));
+        hpack_encoder::encode(block, "content-length", "0");
+        h2_frame::write(m_out, h2_frame_type::headers, h2_frame::end_headers | h2_frame::end_stream, id, block);
+        reset_stream(id, h2_error::no_error);
+    }
+
+    void reset_stream(uint32_t id, h2_error error) {
+        std::string payload;
+        h2_frame::write_u32(payload, static_cast<uint32_t>(error));
+        h2_frame::write(m_out, h2_frame_type::rst_stream, 0, id, payload);
+        m_streams.erase(id);
+    }
+
+    bool fail(h2_error error) {
+        std::string payload;
+        h2_frame::write_u32(payload, m_last_stream);
+        h2_frame::write_u32(payload, static_cast<uint32_t>(error));
+        h2_frame::write(m_out, h2_frame_type::goaway, 0, 0, payload);
+        m_closed = true;
+        return false;
+    }
+
+    // Lowercase visible names, ':' only as a pseudo-header prefix, and values
+    // without CR, LF, NUL or surrounding whitespace (RFC 9113 section 8.2.1).
+    static bool valid_field(std::string_view name, std::string_view value) {
+        if (name.empty()) {
+            return false;
+        }
+        for (size_t i = 0; i < name.size(); ++i) {
+            auto c = static_cast<unsigned char>(name[i]);
+            if (c <= 0x20 || c >= 0x7f || (c >= 'A' && c <= 'Z') || (c == ':' && i > 0)) {
+                return false;
+            }
+        }
+        if (!value.empty() && (value.front() == ' ' || value.front() == '\t'
+                               || value.back() == ' ' || value.back() == '\t')) {
+            return false;
+        }
+        return value.find_first_of(std::string_view{"\r\n\0", 3}) == std::string_view::npos;
+    }
+
+    // Fields that are malformed in an HTTP/2 message (RFC 9113 section 8.2.2).
+    static bool connection_specific(std::string_view name) {
+        return name == "connection" || name == "upgrade" || name == "keep-alive"
+               || name == "proxy-connection" || name == "transfer-encoding";
+    }
+
+    static void add_setting(std::string& out, uint16_t id, uint32_t value) {
+        out.push_back(static_cast<char>(id >> 8));
+        out.push_back(static_cast<char>(id));
+        h2_frame::write_u32(out, value);
+    }
+
+    endpoint& m_root;
+    hpack_decoder m_decoder;
+    std::string m_in;
+    std::string m_out;
+    std::string m_header_block;
+    std::map<uint32_t, stream> m_streams;
+    std::deque<uint32_t> m_ready;
+    uint32_t m_last_stream{0};
+    uint32_t m_continuation_stream{0};
+    uint32_t m_continuation_id{0};
+    uint32_t m_peer_max_frame{max_frame_size};
+    int64_t m_peer_initial_window{default_window};
+    int64_t m_send_window{default_window};
+    bool m_preface_received{false};
+    bool m_settings_received{false};
+    bool m_closed{false};
+};
+
+}
+
+#endif //RESTPP_HTTP2_HPP
@@ -0,0 +1,356 @@
+//
+// Rate limiting and admission control.
+//
+
+#ifndef RESTPP_LIMITS_HPP
+#define RESTPP_LIMITS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "restpp.hpp"
+
+namespace restpp {
+
+// Token bucket implemented as GCRA (generic cell rate algorithm): the whole
+// bucket state is a single "theoretical arrival time", so acquiring a token
+// is one CAS and never takes a lock.
+class token_bucket {
+public:
+    using clock = std::chrono::steady_clock;
+
+    token_bucket() = default;
+    token_bucket(double tokens_per_second, double burst) {
+        configure(tokens_per_second, burst);
+    }
+
+    // Not thread safe: call before the bucket is shared.
+    void configure(double tokens_per_second, double burst) {
+        if (!(tokens_per_second > 0) || !std::isfinite(tokens_per_second)
+            || !(burst >= 0) || !std::isfinite(burst)) {
+            throw std::invalid_argument{"token_bucket: rate must be positive and burst non-negative"};
+        }
+        // Keep both values well inside int64_t so try_acquire cannot overflow
+        constexpr double max_ticks = static_cast<double>(INT64_MAX / 4);
+        auto interval = std::clamp(1e9 / tokens_per_second, 1.0, max_ticks);
+        m_interval = static_cast<int64_t>(interval);
+        m_tolerance = static_cast<int64_t>(std::min(interval * burst, max_ticks));
+    }
+
+    bool try_acquire(clock::time_point now = clock::now()) {
+        auto t = ticks(now);
+        auto tat = m_tat.load(std::memory_order_relaxed);
+        while (true) {
+            auto next = std::max(tat, t) + m_interval;
+            if (next - t > m_tolerance) {
+                return false;
+            }
+            if (m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // Gives back a token taken by try_acquire.
+    void refund() { m_tat.fetch_sub(m_interval, std::memory_order_relaxed); }
+
+    // A full bucket behaves exactly like a freshly created one.
+    [[nodiscard]] bool full(clock::time_point now = clock::now()) const {
+        return m_tat.load(std::memory_order_relaxed) <= ticks(now);
+    }
+
+    void reset() { m_tat.store(0, std::memory_order_relaxed); }
+
+private:
+    static int64_t ticks(clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    }
+
+    std::atomic<int64_t> m_tat{0};
+    int64_t m_interval{0};
+    int64_t m_tolerance{0};
+};
+
+// One token bucket per key, kept in a fixed open-addressed table. Slots are
+// claimed with a CAS on the key hash; a slot whose bucket is full again can be
+// taken over by another key since its state carries no information. When all
+// probed slots are busy the key shares its home slot, which only errs on the
+// side of limiting.
+class rate_limiter {
+    static constexpr size_t max_probes = 8;
+public:
+    using clock = token_bucket::clock;
+
+    rate_limiter(double requests_per_second, double burst, size_t slots = 4096)
+            : m_slots(round_up(slots)) {
+        for (auto& s: m_slots) {
+            s.bucket.configure(requests_per_second, burst);
+        }
+    }
+
+    bool try_acquire(std::string_view key, clock::time_point now = clock::now()) {
+        return find_slot(hash(key), now).bucket.try_acquire(now);
+    }
+
+    void refund(std::string_view key, clock::time_point now = clock::now()) {
+        find_slot(hash(key), now).bucket.refund();
+    }
+
+private:
+    struct slot {
+        std::atomic<uint64_t> key{0};
+        token_bucket bucket;
+    };
+
+    slot& find_slot(uint64_t h, clock::time_point now) {
+        size_t mask = m_slots.size() - 1;
+        // The key may already own a slot further down its chain, and that
+        // slot holds its state; only claim a new one when it owns none.
+        for (size_t i = 0; i < max_probes; ++i) {
+            auto& s = m_slots[(h + i) & mask];
+            if (s.key.load(std::memory_order_acquire) == h) {
+                return s;
+            }
+        }
+        for (size_t i = 0; i < max_probes; ++i) {
+            auto& s = m_slots[(h + i) & mask];
+            auto current = s.key.load(std::memory_order_acquire);
+            if ((current == 0 || s.bucket.full(now))
+                && s.key.compare_exchange_strong(current, h, std::memory_order_acq_rel)) {
+                return s;
+            }
+            if (current == h) {
+                return s;
+            }
+        }
+        return m_slots[h & mask];
+    }
+
+    static uint64_t hash(std::string_view key) {
+        // 0 marks an empty slot
+        auto h = static_cast<uint64_t>(std::hash<std::string_view>{}(key));
+        return h ? h : 1;
+    }
+
+    static size_t round_up(size_t n) {
+        size_t size = 1;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<slot> m_slots;
+};
+
+// Global cap on requests being handled at the same time.
+class concurrency_limiter {
+public:
+    class permit {
+    public:
+        permit() = default;
+        explicit permit(concurrency_limiter* owner) : m_owner{owner} {}
+        permit(permit&& other) noexcept : m_owner{std::exchange(other.m_owner, nullptr)} {}
+        permit& operator=(permit&& other) noexcept {
+            if (this != &other) {
+                release();
+                m_owner = std::exchange(other.m_owner, nullptr);
+            }
+            return *this;
+        }
+        permit(const permit&) = delete;
+        permit& operator=(const permit&) = delete;
+        ~permit() { release(); }
+
+        explicit operator bool() const { return m_owner != nullptr; }
+
+        void release() {
+            if (m_owner) {
+                m_owner->m_in_flight.fetch_sub(1, std::memory_order_release);
+                m_owner = nullptr;
+            }
+        }
+    private:
+        concurrency_limiter* m_owner{nullptr};
+    };
+
+    explicit concurrency_limiter(size_t max_in_flight) : m_max{max_in_flight} {}
+
+    permit try_acquire() {
+        auto current = m_in_flight.load(std::memory_order_relaxed);
+        do {
+            if (current >= m_max) {
+                return permit{};
+            }
+        } while (!m_in_flight.compare_exchange_weak(current, current + 1, std::memory_order_acquire));
+        return permit{this};
+    }
+
+    [[nodiscard]] size_t in_flight() const { return m_in_flight.load(std::memory_order_relaxed); }
+    [[nodiscard]] size_t max_in_flight() const { return m_max; }
+
+private:
+    std::atomic<size_t> m_in_flight{0};
+    size_t m_max;
+};
+
+enum class rate_key {
+    client_ip,
+    header,
+    route,
+};
+
+// Decides whether a raw request may be handled before it is parsed. Only the
+// request line and, for header keys, the header block are scanned.
+class admission_control {
+public:
+    class admission {
+    public:
+        explicit admission(http_code code) : m_code{code} {}
+        explicit admission(concurrency_limiter::permit p)
+                : m_code{http_code::http_200_ok}, m_permit{std::move(p)} {}
+
+        explicit operator bool() const { return m_code == http_code::http_200_ok; }
+        [[nodiscard]] http_code code() const { return m_code; }
+    private:
+        http_code m_code;
+        concurrency_limiter::permit m_permit;
+    };
+
+    explicit admission_control(size_t max_in_flight = SIZE_MAX) : m_concurrency{max_in_flight} {}
+
+    void add_rate_limit(rate_key key, double requests_per_second, double burst, std::string header = {}) {
+        m_limits.push_back({key, std::move(header),
+                            std::make_unique<rate_limiter>(requests_per_second, burst)});
+    }
+
+    // Only admitted requests are charged to the rate limits: load is shed
+    // before any token is taken, and tokens taken before a later limit
+    // refuses are given back, so overload or one exhausted limit does not
+    // drain a client's other buckets.
+    admission admit(std::string_view raw_text, std::string_view client_ip = {},
+                    token_bucket::clock::time_point now = token_bucket::clock::now()) {
+        auto p = m_concurrency.try_acquire();
+        if (!p) {
+            return admission{http_code::http_503_service_unavailable};
+        }
+        std::string scratch;
+        for (size_t i = 0; i < m_limits.size(); ++i) {
+            auto& l = m_limits[i];
+            if (!l.limiter->try_acquire(extract_key(l, raw_text, client_ip, scratch), now)) {
+                while (i-- > 0) {
+                    m_limits[i].limiter->refund(extract_key(m_limits[i], raw_text, client_ip, scratch), now);
+                }
+                return admission{http_code::http_429_too_many_requests};
+            }
+        }
+        return admission{std::move(p)};
+    }
+
+    std::shared_ptr<response> handle_request(endpoint& e, std::string_view raw_text,
+                                             std::string_view client_ip = {}) {
+        auto a = admit(raw_text, client_ip);
+        if (!a) {
+            auto text = a.code() == http_code::http_429_too_many_requests
+                        ? "Too Many Requests" : "Service Unavailable";
+            return std::make_shared<response>(a.code(), text);
+        }
+        return e.handle_request(std::make_shared<request>(raw_text));
+    }
+
+    [[nodiscard]] const concurrency_limiter& concurrency() const { return m_concurrency; }
+
+private:
+    struct limit {
+        rate_key key;
+        std::string header;
+        std::unique_ptr<rate_limiter> limiter;
+    };
+
+    static std::string_view extract_key(const limit& l, std::string_view text, std::string_view client_ip,
+                                        std::string& scratch) {
+        switch (l.key) {
+            case rate_key::client_ip:
+                return client_ip;
+            case rate_key::route:
+                return route_of(text, scratch);
+            case rate_key::header:
+                return header_of(text, l.header);
+        }
+        return {};
+    }
+
+    // The router skips empty path segments, so /foo, /foo/ and //foo share
+    // one key, rebuilt into route.
+    static std::string_view route_of(std::string_view text, std::string& route) {
+        route.clear();
+        size_t start = text.find(' ');
+        if (start == std::string::npos) {
+            return {};
+        }
+        ++start;
+        size_t end = text.find_first_of(" ?\r", start);
+        auto path = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        size_t pos = 0;
+        while (pos < path.size()) {
+            size_t next = path.find('/', pos);
+            if (next == std::string::npos) {
+                next = path.size();
+            }
+            if (next > pos) {
+                route.append("/").append(path.substr(pos, next - pos));
+            }
+            pos = next + 1;
+        }
+        return route;
+    }
+
+    static std::string_view header_of(std::string_view text, std::string_view name) {
+        size_t pos = text.find("\r\n");
+        while (pos != std::string::npos) {
+            pos += 2;
+            size_t end = text.find("\r\n", pos);
+            auto line = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            if (line.empty()) {
+                break;
+            }
+            size_t sep = line.find(':');
+            if (sep != std::string::npos && iequals(line.substr(0, sep), name)) {
+                size_t value = line.find_first_not_of(' ', sep + 1);
+                return value == std::string::npos ? std::string_view{} : line.substr(value);
+            }
+            pos = end;
+        }
+        return {};
+    }
+
+    static bool iequals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<limit> m_limits;
+    concurrency_limiter m_concurrency;
+};
+
+}
+
+#endif //RESTPP_LIMITS_HPP
@@ -6,6 +6,9 @@
 #define RESTPP_RESTPP_HPP
 
 #include <string>
+#include <functional>
+#include <memory>
+#include <variant>
 #include <map>
 #include <unordered_map>
 #include <utility>
@@ -0,0 +1,342 @@
+//
+// Timing wheel and request deadlines.
+//
+
+#ifndef RESTPP_TIMEOUTS_HPP
+#define RESTPP_TIMEOUTS_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "http.hpp"
+
+namespace restpp {
+
+// Hierarchical timing wheel: levels of 64 slots, each level 64 times coarser
+// than the one below. Timers live in a pooled intrusive list so scheduling
+// and cancelling are O(1); a slot of an upper level is cascaded down once
+// when the level below wraps around.
+class timing_wheel {
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned slots_per_level = 1u << slot_bits;
+    static constexpr unsigned levels = 4;
+    static constexpr uint64_t max_delta = (uint64_t{1} << (slot_bits * levels)) - 1;
+    static constexpr uint32_t npos = UINT32_MAX;
+    static constexpr uint32_t firing_slot = levels * slots_per_level;
+public:
+    using clock = std::chrono::steady_clock;
+    using timer_id = uint64_t;
+    using callback_type = std::function<void()>;
+
+    explicit timing_wheel(clock::duration tick = std::chrono::milliseconds{1},
+                          clock::time_point start = clock::now())
+            : m_tick{tick}, m_start{start} {
+        m_slots.fill(npos);
+    }
+
+    timer_id schedule(clock::time_point when, callback_type callback) {
+        auto index = allocate();
+        auto& n = m_nodes[index];
+        n.expires = std::max(to_ticks(when, true), m_next);
+        n.callback = std::move(callback);
+        insert(index);
+        ++m_count;
+        return (uint64_t{n.generation} << 32) | index;
+    }
+
+    timer_id schedule(clock::duration delay, callback_type callback) {
+        return schedule(now() + delay, std::move(callback));
+    }
+
+    // Returns false when the timer already fired or was cancelled.
+    bool cancel(timer_id id) {
+        auto index = static_cast<uint32_t>(id);
+        if (index >= m_nodes.size()) {
+            return false;
+        }
+        auto& n = m_nodes[index];
+        if (n.generation != static_cast<uint32_t>(id >> 32) || n.slot == npos) {
+            return false;
+        }
+        unlink(index);
+        release(index);
+        --m_count;
+        return true;
+    }
+
+    // Fires every timer due at or before now, returns how many fired.
+    size_t advance(clock::time_point now) {
+        auto target = to_ticks(now, false);
+        size_t fired = 0;
+        while (m_next <= target) {
+            if (m_count == 0) {
+                m_next = target + 1;
+                break;
+            }
+            fired += run_tick();
+        }
+        return fired;
+    }
+
+    [[nodiscard]] size_t size() const { return m_count; }
+    [[nodiscard]] bool empty() const { return m_count == 0; }
+
+    // Time of the last processed tick.
+    [[nodiscard]] clock::time_point now() const {
+        return m_start + m_tick * static_cast<clock::rep>(m_next ? m_next - 1 : 0);
+    }
+
+private:
+    struct node {
+        uint64_t expires{0};
+        uint32_t prev{npos};
+        uint32_t next{npos};
+        uint32_t slot{npos};
+        uint32_t generation{0};
+        callback_type callback;
+    };
+
+    uint64_t to_ticks(clock::time_point t, bool round_up) const {
+        if (t <= m_start) {
+            return 0;
+        }
+        auto elapsed = t - m_start;
+        auto ticks = static_cast<uint64_t>(elapsed / m_tick);
+        if (round_up && elapsed % m_tick != clock::duration::zero()) {
+            ++ticks;
+        }
+        return ticks;
+    }
+
+    uint32_t allocate() {
+        if (m_free != npos) {
+            auto index = m_free;
+            m_free = m_nodes[index].next;
+            return index;
+        }
+        m_nodes.emplace_back();
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    void release(uint32_t index) {
+        auto& n = m_nodes[index];
+        n.callback = nullptr;
+        n.slot = npos;
+        n.prev = npos;
+        ++n.generation;
+        n.next = m_free;
+        m_free = index;
+    }
+
+    uint32_t& head(uint32_t slot) {
+        return slot == firing_slot ? m_firing : m_slots[slot];
+    }
+
+    void push(uint32_t slot, uint32_t index) {
+        auto& n = m_nodes[index];
+        auto& h = head(slot);
+        n.slot = slot;
+        n.prev = npos;
+        n.next = h;
+        if (h != npos) {
+            m_nodes[h].prev = index;
+        }
+        h = index;
+    }
+
+    void unlink(uint32_t index) {
+        auto& n = m_nodes[index];
+        if (n.prev != npos) {
+            m_nodes[n.prev].next = n.next;
+        } else {
+            head(n.slot) = n.next;
+        }
+        if (n.next != npos) {
+            m_nodes[n.next].prev = n.prev;
+        }
+        n.prev = n.next = n.slot = npos;
+    }
+
+    void insert(uint32_t index) {
+        // Timers beyond the wheel's range are parked in the farthest slot
+        // and re-inserted when they come down.
+        auto expires = std::min(m_nodes[index].expires, m_next + max_delta);
+        auto delta = expires - m_next;
+        unsigned level = 0;
+        while (level + 1 < levels && delta >= (uint64_t{1} << (slot_bits * (level + 1)))) {
+            ++level;
+        }
+        auto slot = (expires >> (slot_bits * level)) & (slots_per_level - 1);
+        push(static_cast<uint32_t>(level * slots_per_level + slot), index);
+    }
+
+    void cascade(unsigned level) {
+        auto slot = static_cast<uint32_t>(level * slots_per_level
+                                          + ((m_next >> (slot_bits * level)) & (slots_per_level - 1)));
+        auto index = std::exchange(m_slots[slot], npos);
+        while (index != npos) {
+            auto next = m_nodes[index].next;
+            insert(index);
+            index = next;
+        }
+    }
+
+    size_t run_tick() {
+        auto slot = static_cast<uint32_t>(m_next & (slots_per_level - 1));
+        for (unsigned level = 1; level < levels; ++level) {
+            if (((m_next >> (slot_bits * (level - 1))) & (slots_per_level - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        // Detach the slot first so callbacks may schedule or cancel freely
+        m_firing = std::exchange(m_slots[slot], npos);
+        for (auto index = m_firing; index != npos; index = m_nodes[index].next) {
+            m_nodes[index].slot = firing_slot;
+        }
+        ++m_next;
+
+        size_t fired = 0;
+        while (m_firing != npos) {
+            auto index = m_firing;
+            unlink(index);
+            if (m_nodes[index].expires >= m_next) {
+                insert(index);
+                continue;
+            }
+            auto callback = std::move(m_nodes[index].callback);
+            release(index);
+            --m_count;
+            ++fired;
+            callback();
+        }
+        return fired;
+    }
+
+    clock::duration m_tick;
+    clock::time_point m_start;
+    uint64_t m_next{0};
+    size_t m_count{0};
+    uint32_t m_free{npos};
+    uint32_t m_firing{npos};
+    std::array<uint32_t, levels * slots_per_level> m_slots{};
+    std::vector<node> m_nodes;
+};
+
+enum class deadline_phase {
+    header_read,
+    body_read,
+    handler,
+    keep_alive_idle,
+};
+
+struct timeouts {
+    std::chrono::milliseconds header_read{10'000};
+    std::chrono::milliseconds body_read{30'000};
+    std::chrono::milliseconds handler{60'000};
+    std::chrono::milliseconds keep_alive_idle{75'000};
+};
+
+// Arms one deadline per connection for the phase it is currently in. When a
+// deadline passes, on_expire receives the response to send back: 408 while
+// reading the request, 504 when the handler is too slow, and nullptr for an
+// idle keep-alive connection that should simply be closed.
+class deadline_tracker {
+public:
+    using clock = timing_wheel::clock;
+    using connection_id = uint64_t;
+    using expire_handler = std::function<void(connection_id, deadline_phase, std::shared_ptr<response>)>;
+
+    deadline_tracker(timeouts limits, expire_handler on_expire,
+                     clock::duration tick = std::chrono::milliseconds{10},
+                     clock::time_point start = clock::now())
+            : m_limits{limits}, m_on_expire{std::move(on_expire)}, m_wheel{tick, start} {}
+
+    // Scheduled callbacks capture this
+    deadline_tracker(const deadline_tracker&) = delete;
+    deadline_tracker& operator=(const deadline_tracker&) = delete;
+    deadline_tracker(deadline_tracker&&) = delete;
+    deadline_tracker& operator=(deadline_tracker&&) = delete;
+
+    // Entering the phase the connection is already in keeps the original
+    // deadline, so a client trickling bytes cannot extend it.
+    void enter(connection_id id, deadline_phase phase, clock::time_point now = clock::now()) {
+        auto it = m_armed.find(id);
+        if (it != m_armed.end()) {
+            if (it->second.phase == phase) {
+                return;
+            }
+            m_wheel.cancel(it->second.timer);
+        } else {
+            it = m_armed.emplace(id, armed{}).first;
+        }
+        it->second.phase = phase;
+        it->second.timer = m_wheel.schedule(now + limit(phase), [this, id, phase] {
+            m_armed.erase(id);
+            m_on_expire(id, phase, make_response(phase));
+        });
+    }
+
+    void leave(connection_id id) {
+        if (auto it = m_armed.find(id); it != m_armed.end()) {
+            m_wheel.cancel(it->second.timer);
+            m_armed.erase(it);
+        }
+    }
+
+    size_t advance(clock::time_point now = clock::now()) {
+        return m_wheel.advance(now);
+    }
+
+    [[nodiscard]] size_t size() const { return m_armed.size(); }
+
+private:
+    struct armed {
+        deadline_phase phase;
+        timing_wheel::timer_id timer;
+    };
+
+    [[nodiscard]] clock::duration limit(deadline_phase phase) const {
+        switch (phase) {
+            case deadline_phase::header_read:
+                return m_limits.header_read;
+            case deadline_phase::body_read:
+                return m_limits.body_read;
+            case deadline_phase::handler:
+                return m_limits.handler;
+            case deadline_phase::keep_alive_idle:
+                return m_limits.keep_alive_idle;
+        }
+        return {};
+    }
+
+    static std::shared_ptr<response> make_response(deadline_phase phase) {
+        switch (phase) {
+            case deadline_phase::header_read:
+            case deadline_phase::body_read:
+                return std::make_shared<response>(http_code::http_408_request_timeout, "Request Timeout");
+            case deadline_phase::handler:
+                return std::make_shared<response>(http_code::http_504_gateway_timeout, "Gateway Timeout");
+            case deadline_phase::keep_alive_idle:
+                break;
+        }
+        return nullptr;
+    }
+
+    timeouts m_limits;
+    expire_handler m_on_expire;
+    timing_wheel m_wheel;
+    std::unordered_map<connection_id, armed> m_armed;
+};
+
+}
+
+#endif //RESTPP_TIMEOUTS_HPP
@@ -0,0 +1,894 @@
+//
+// WebSocket upgrade and framing (RFC 6455, RFC 7692).
+//
+
+#ifndef RESTPP_WEBSOCKET_HPP
+#define RESTPP_WEBSOCKET_HPP
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef RESTPP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "restpp.hpp"
+
+namespace restpp {
+
+enum class websocket_opcode : uint8_t {
+    continuation = 0x0,
+    text = 0x1,
+    binary = 0x2,
+    close = 0x8,
+    ping = 0x9,
+    pong = 0xa,
+};
+
+enum class websocket_status : uint16_t {
+    normal_closure = 1000,
+    going_away = 1001,
+    protocol_error = 1002,
+    unsupported_data = 1003,
+    no_status_received = 1005,
+    invalid_payload = 1007,
+    message_too_big = 1009,
+    internal_error = 1011,
+};
+
+// XORs data with the 4 byte masking key; masking and unmasking are the same
+// operation. The key is repeated over a full vector register so the bulk of
+// the payload is done 16 bytes at a time.
+inline void websocket_mask(char* data, size_t size, const uint8_t key[4]) {
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64) || defined(__ARM_NEON)
+    uint8_t pattern[16];
+    for (size_t k = 0; k < sizeof(pattern); ++k) {
+        pattern[k] = key[k & 3];
+    }
+#if defined(__ARM_NEON) && !(defined(__SSE2__) || defined(_M_X64))
+    auto mask = vld1q_u8(pattern);
+    for (; i + 16 <= size; i += 16) {
+        auto p = reinterpret_cast<uint8_t*>(data + i);
+        vst1q_u8(p, veorq_u8(vld1q_u8(p), mask));
+    }
+#else
+    auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    for (; i + 16 <= size; i += 16) {
+        auto p = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+    }
+#endif
+#else
+    uint64_t mask;
+    uint8_t pattern[8];
+    for (size_t k = 0; k < sizeof(pattern); ++k) {
+        pattern[k] = key[k & 3];
+    }
+    std::memcpy(&mask, pattern, sizeof(mask));
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        word ^= mask;
+        std::memcpy(data + i, &word, sizeof(word));
+    }
+#endif
+    // Vector widths are multiples of 4 so the key phase is unchanged here
+    for (; i < size; ++i) {
+        data[i] = static_cast<char>(data[i] ^ key[i & 3]);
+    }
+}
+
+// Strict UTF-8 check: no overlong forms, surrogates or code points past
+// U+10FFFF. Runs of ASCII are skipped 8 bytes at a time.
+inline bool websocket_valid_utf8(std::string_view text) {
+    auto p = reinterpret_cast<const uint8_t*>(text.data());
+    auto end = p + text.size();
+    while (p < end) {
+        if (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            if (!(word & 0x8080808080808080ull)) {
+                p += 8;
+                continue;
+            }
+        }
+        auto c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t length;
+        uint8_t low = 0x80;
+        uint8_t high = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            length = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            length = 3;
+            if (c == 0xe0) {
+                low = 0xa0;
+            } else if (c == 0xed) {
+                high = 0x9f;
+            }
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            length = 4;
+            if (c == 0xf0) {
+                low = 0x90;
+            } else if (c == 0xf4) {
+                high = 0x8f;
+            }
+        } else {
+            return false;
+        }
+        if (static_cast<size_t>(end - p) < length || p[1] < low || p[1] > high) {
+            return false;
+        }
+        for (size_t i = 2; i < length; ++i) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        p += length;
+    }
+    return true;
+}
+
+struct websocket_frame {
+    static constexpr uint8_t fin = 0x80;
+    static constexpr uint8_t rsv1 = 0x40;
+
+    // Appends one frame; clients pass a mask key, servers do not.
+    static void encode(std::string& out, websocket_opcode opcode, std::string_view payload,
+                       uint8_t flags = fin, const uint8_t* mask_key = nullptr) {
+        out.push_back(static_cast<char>(flags | static_cast<uint8_t>(opcode)));
+        uint8_t masked = mask_key ? 0x80 : 0;
+        if (payload.size() < 126) {
+            out.push_back(static_cast<char>(masked | payload.size()));
+        } else if (payload.size() <= 0xffff) {
+            out.push_back(static_cast<char>(masked | 126));
+            out.push_back(static_cast<char>(payload.size() >> 8));
+            out.push_back(static_cast<char>(payload.size()));
+        } else {
+            out.push_back(static_cast<char>(masked | 127));
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out.push_back(static_cast<char>(static_cast<uint64_t>(payload.size()) >> shift));
+            }
+        }
+        if (!mask_key) {
+            out.append(payload);
+            return;
+        }
+        out.append(reinterpret_cast<const char*>(mask_key), 4);
+        auto start = out.size();
+        out.append(payload);
+        websocket_mask(out.data() + start, payload.size(), mask_key);
+    }
+};
+
+struct websocket_message {
+    websocket_opcode opcode;
+    // Points into the connection's receive buffer and is only valid for
+    // the duration of the callback.
+    std::string_view data;
+};
+
+class websocket_connection;
+
+struct websocket_callbacks {
+    std::function<void(websocket_connection&, const websocket_message&)> on_message;
+    std::function<void(websocket_connection&, websocket_status code, std::string_view reason)> on_close;
+    bool compression{true};
+    size_t max_message_size{16 * 1024 * 1024};
+};
+
+// Negotiated permessage-deflate parameters.
+struct websocket_deflate_params {
+    bool enabled{false};
+    bool server_no_context_takeover{false};
+    bool client_no_context_takeover{false};
+    int server_max_window_bits{15};
+};
+
+// Returned by a handler to accept an upgrade. The layer doing the I/O sends
+// handshake() and then hands the socket over to a websocket_connection built
+// from this response.
+class websocket_response : public response {
+public:
+    websocket_response(std::shared_ptr<const websocket_callbacks> callbacks, websocket_deflate_params deflate)
+            : response(http_code::http_101_switching_protocols, ""),
+              m_callbacks{std::move(callbacks)}, m_deflate{deflate} {}
+
+    [[nodiscard]] std::string handshake() const {
+        std::string out{"HTTP/1.1 101 Switching Protocols\r\n"};
+        for (const auto& [name, value]: headers()) {
+            out.append(name).append(": ").append(value).append("\r\n");
+        }
+        out.append("\r\n");
+        return out;
+    }
+
+    [[nodiscard]] const std::shared_ptr<const websocket_callbacks>& callbacks() const { return m_callbacks; }
+    [[nodiscard]] const websocket_deflate_params& deflate() const { return m_deflate; }
+
+private:
+    std::shared_ptr<const websocket_callbacks> m_callbacks;
+    websocket_deflate_params m_deflate;
+};
+
+#ifdef RESTPP_WITH_ZLIB
+// permessage-deflate codec for one connection.
+class websocket_deflate {
+public:
+    explicit websocket_deflate(const websocket_deflate_params& params) : m_params{params} {
+        deflateInit2(&m_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -params.server_max_window_bits,
+                     8, Z_DEFAULT_STRATEGY);
+        inflateInit2(&m_inflate, -15);
+    }
+    ~websocket_deflate() {
+        deflateEnd(&m_deflate);
+        inflateEnd(&m_inflate);
+    }
+    websocket_deflate(const websocket_deflate&) = delete;
+    websocket_deflate& operator=(const websocket_deflate&) = delete;
+
+    bool compress(std::string_view in, std::string& out) {
+        out.clear();
+        m_deflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        m_deflate.avail_in = static_cast<uInt>(in.size());
+        do {
+            auto used = out.size();
+            out.resize(used + std::max<size_t>(in.size() / 2, 256));
+            m_deflate.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+            m_deflate.avail_out = static_cast<uInt>(out.size() - used);
+            if (deflate(&m_deflate, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+                return false;
+            }
+            out.resize(out.size() - m_deflate.avail_out);
+        } while (m_deflate.avail_out == 0);
+        // Drop the empty stored block that ends every sync flush
+        if (out.size() >= 4 && out.compare(out.size() - 4, 4, "\x00\x00\xff\xff", 4) == 0) {
+            out.resize(out.size() - 4);
+        }
+        if (m_params.server_no_context_takeover) {
+            deflateReset(&m_deflate);
+        }
+        return true;
+    }
+
+    bool decompress(std::string_view in, std::string& out, size_t max_size) {
+        out.clear();
+        static const char tail[] = {0x00, 0x00, char(0xff), char(0xff)};
+        for (auto part: {in, std::string_view{tail, sizeof(tail)}}) {
+            m_inflate.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(part.data()));
+            m_inflate.avail_in = static_cast<uInt>(part.size());
+            do {
+                auto used = out.size();
+                out.resize(used + std::max<size_t>(part.size() * 2, 1024));
+                m_inflate.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+                m_inflate.avail_out = static_cast<uInt>(out.size() - used);
+                auto status = inflate(&m_inflate, Z_SYNC_FLUSH);
+                out.resize(out.size() - m_inflate.avail_out);
+                if (status == Z_STREAM_END) {
+                    // The peer ended the deflate stream; the next message starts a new one
+                    inflateReset(&m_inflate);
+                    return out.size() <= max_size;
+                }
+                if ((status != Z_OK && status != Z_BUF_ERROR) || out.size() > max_size) {
+                    return false;
+                }
+            } while (m_inflate.avail_out == 0);
+        }
+        if (m_params.client_no_context_takeover) {
+            inflateReset(&m_inflate);
+        }
+        return true;
+    }
+
+private:
+    websocket_deflate_params m_params;
+    z_stream m_deflate{};
+    z_stream m_inflate{};
+};
+#endif
+
+// Server side of one WebSocket connection. Like h2_connection it does no I/O.
+// Incoming frames are unmasked in place and fragmented messages are joined
+// inside the receive buffer, so handlers get views without extra copies.
+// Outgoing data is a queue of shared buffers, which lets a broadcast frame be
+// encoded once and queued on any number of connections.
+class websocket_connection {
+public:
+    using buffer = std::shared_ptr<const std::string>;
+
+    explicit websocket_connection(const websocket_response& upgrade)
+            : m_callbacks{upgrade.callbacks()} {
+#ifdef RESTPP_WITH_ZLIB
+        if (upgrade.deflate().enabled) {
+            m_deflate = std::make_unique<websocket_deflate>(upgrade.deflate());
+        }
+#endif
+    }
+
+    // Zero-copy receive: read straight into prepare(n), then commit the
+    // number of bytes actually read.
+    char* prepare(size_t n) {
+        m_in.resize(m_filled + n);
+        return m_in.data() + m_filled;
+    }
+
+    bool commit(size_t n) {
+        m_filled += n;
+        process();
+        return !m_closed;
+    }
+
+    bool feed(std::string_view bytes) {
+        std::memcpy(prepare(bytes.size()), bytes.data(), bytes.size());
+        return commit(bytes.size());
+    }
+
+    void send_text(std::string_view text) { send(websocket_opcode::text, text); }
+    void send_binary(std::string_view data) { send(websocket_opcode::binary, data); }
+
+    void send(websocket_opcode opcode, std::string_view payload) {
+        if (m_close_sent) {
+            return;
+        }
+        auto frame = std::make_shared<std::string>();
+#ifdef RESTPP_WITH_ZLIB
+        if (m_deflate && payload.size() >= min_compress_size && m_deflate->compress(payload, m_scratch)) {
+            websocket_frame::encode(*frame, opcode, m_scratch, websocket_frame::fin | websocket_frame::rsv1);
+            m_out.push_back(std::move(frame));
+            return;
+        }
+#endif
+        websocket_frame::encode(*frame, opcode, payload);
+        m_out.push_back(std::move(frame));
+    }
+
+    // Queues an already encoded frame without copying it.
+    void send_frame(buffer frame) {
+        if (!m_close_sent) {
+            m_out.push_back(std::move(frame));
+        }
+    }
+
+    void close(websocket_status code = websocket_status::normal_closure, std::string_view reason = {}) {
+        if (m_close_sent) {
+            return;
+        }
+        std::string payload;
+        if (code != websocket_status::no_status_received) {
+            payload.push_back(static_cast<char>(static_cast<uint16_t>(code) >> 8));
+            payload.push_back(static_cast<char>(code));
+            payload.append(reason.substr(0, 123));
+        }
+        auto frame = std::make_shared<std::string>();
+        websocket_frame::encode(*frame, websocket_opcode::close, payload);
+        m_out.push_back(std::move(frame));
+        m_close_sent = true;
+    }
+
+    // Pending output as a list of views for a gathered write.
+    [[nodiscard]] std::vector<std::string_view> output() const {
+        std::vector<std::string_view> views;
+        views.reserve(m_out.size());
+        for (size_t i = 0; i < m_out.size(); ++i) {
+            views.emplace_back(std::string_view{*m_out[i]}.substr(i == 0 ? m_out_offset : 0));
+        }
+        return views;
+    }
+
+    void consume_output(size_t n) {
+        while (n > 0 && !m_out.empty()) {
+            auto left = m_out.front()->size() - m_out_offset;
+            if (n < left) {
+                m_out_offset += n;
+                return;
+            }
+            n -= left;
+            m_out.pop_front();
+            m_out_offset = 0;
+        }
+    }
+
+    std::string take_output() {
+        std::string out;
+        for (auto view: output()) {
+            out.append(view);
+        }
+        m_out.clear();
+        m_out_offset = 0;
+        return out;
+    }
+
+    // Received bytes still held: unparsed input and any partial message.
+    [[nodiscard]] size_t buffered() const { return m_filled; }
+
+    // Closed once a close frame was received or a protocol error occurred;
+    // the output may still hold the closing frame.
+    [[nodiscard]] bool closed() const { return m_closed; }
+    [[nodiscard]] bool compressed() const {
+#ifdef RESTPP_WITH_ZLIB
+        return m_deflate != nullptr;
+#else
+        return false;
+#endif
+    }
+
+private:
+    static constexpr size_t min_compress_size = 64;
+
+    void process() {
+        while (!m_closed) {
+            auto available = m_filled - m_pos;
+            if (available < 2) {
+                break;
+            }
+            auto p = reinterpret_cast<uint8_t*>(m_in.data() + m_pos);
+            auto b0 = p[0];
+            auto b1 = p[1];
+            size_t header = 2;
+            uint64_t length = b1 & 0x7f;
+            if (length == 126) {
+                header += 2;
+            } else if (length == 127) {
+                header += 8;
+            }
+            header += 4;
+            if (available < header) {
+                break;
+            }
+            if (length == 126) {
+                length = (uint64_t{p[2]} << 8) | p[3];
+            } else if (length == 127) {
+                length = 0;
+                for (int i = 0; i < 8; ++i) {
+                    length = (length << 8) | p[2 + i];
+                }
+            }
+            if (!(b1 & 0x80)) {
+                // Client frames must be masked
+                return fail(websocket_status::protocol_error);
+            }
+            if (length > m_callbacks->max_message_size) {
+                return fail(websocket_status::message_too_big);
+            }
+            if (available < header + length) {
+                break;
+            }
+
+            auto payload = m_in.data() + m_pos + header;
+            websocket_mask(payload, length, p + header - 4);
+            m_pos += header + length;
+            if (!handle_frame(b0, payload, length)) {
+                return;
+            }
+        }
+        compact();
+    }
+
+    bool handle_frame(uint8_t b0, char* payload, size_t length) {
+        bool final = b0 & websocket_frame::fin;
+        bool rsv1 = b0 & websocket_frame::rsv1;
+        auto opcode = static_cast<websocket_opcode>(b0 & 0x0f);
+        if (b0 & 0x30 || (rsv1 && !compressed())) {
+            fail(websocket_status::protocol_error);
+            return false;
+        }
+
+        switch (opcode) {
+            case websocket_opcode::ping:
+            case websocket_opcode::pong:
+            case websocket_opcode::close:
+                if (!final || rsv1 || length > 125) {
+                    fail(websocket_status::protocol_error);
+                    return false;
+                }
+                return handle_control(opcode, std::string_view{payload, length});
+            case websocket_opcode::text:
+            case websocket_opcode::binary:
+                if (m_assembling) {
+                    fail(websocket_status::protocol_error);
+                    return false;
+                }
+                m_message_opcode = opcode;
+                m_message_compressed = rsv1;
+                if (final) {
+                    return deliver(std::string_view{payload, length});
+                }
+                m_assembling = true;
+                m_message_start = static_cast<size_t>(payload - m_in.data());
+                m_message_size = length;
+                return true;
+            case websocket_opcode::continuation: {
+                if (!m_assembling || rsv1) {
+                    fail(websocket_status::protocol_error);
+                    return false;
+                }
+                if (m_message_size + length > m_callbacks->max_message_size) {
+                    fail(websocket_status::message_too_big);
+                    return false;
+                }
+                // Slide the fragment down so the message stays contiguous
+                auto target = m_in.data() + m_message_start + m_message_size;
+                if (target != payload) {
+                    std::memmove(target, payload, length);
+                }
+                m_message_size += length;
+                if (!final) {
+                    return true;
+                }
+                m_assembling = false;
+                return deliver(std::string_view{m_in.data() + m_message_start, m_message_size});
+            }
+            default:
+                fail(websocket_status::protocol_error);
+                return false;
+        }
+    }
+
+    bool handle_control(websocket_opcode opcode, std::string_view payload) {
+        if (opcode == websocket_opcode::ping) {
+            auto frame = std::make_shared<std::string>();
+            websocket_frame::encode(*frame, websocket_opcode::pong, payload);
+            send_frame(std::move(frame));
+            return true;
+        }
+        if (opcode == websocket_opcode::pong) {
+            return true;
+        }
+        if (payload.size() == 1) {
+            fail(websocket_status::protocol_error);
+            return false;
+        }
+        auto code = websocket_status::no_status_received;
+        std::string_view reason;
+        if (payload.size() >= 2) {
+            auto value = static_cast<uint16_t>((static_cast<uint8_t>(payload[0]) << 8)
+                                               | static_cast<uint8_t>(payload[1]));
+            if (!valid_close_code(value)) {
+                fail(websocket_status::protocol_error);
+                return false;
+            }
+            code = static_cast<websocket_status>(value);
+            reason = payload.substr(2);
+            if (!websocket_valid_utf8(reason)) {
+                fail(websocket_status::invalid_payload);
+                return false;
+            }
+        }
+        close(code);
+        m_closed = true;
+        if (m_callbacks->on_close) {
+            m_callbacks->on_close(*this, code, reason);
+        }
+        return false;
+    }
+
+    bool deliver(std::string_view data) {
+        if (m_message_compressed) {
+#ifdef RESTPP_WITH_ZLIB
+            if (!m_deflate->decompress(data, m_scratch, m_callbacks->max_message_size)) {
+                fail(websocket_status::invalid_payload);
+                return false;
+            }
+            data = m_scratch;
+#endif
+        }
+        if (m_message_opcode == websocket_opcode::text && !websocket_valid_utf8(data)) {
+            fail(websocket_status::invalid_payload);
+            return false;
+        }
+        if (m_callbacks->on_message) {
+            m_callbacks->on_message(*this, websocket_message{m_message_opcode, data});
+        }
+        return !m_closed;
+    }
+
+    // Codes a peer may send: 1005, 1006 and 1015 are reserved for local use
+    // and 1016-2999 are reserved for future protocol extensions.
+    static bool valid_close_code(uint16_t code) {
+        return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014)
+               || (code >= 3000 && code <= 4999);
+    }
+
+    void fail(websocket_status code) {
+        close(code);
+        m_closed = true;
+        if (m_callbacks->on_close) {
+            m_callbacks->on_close(*this, code, {});
+        }
+    }
+
+    // Drops consumed bytes, keeping a partially assembled message in place.
+    // Frames handled since the message started (control frames, fragment
+    // headers) are squeezed out from behind it, so only its payload, which
+    // max_message_size bounds, stays buffered.
+    void compact() {
+        auto keep = m_pos;
+        if (m_assembling) {
+            auto end = m_message_start + m_message_size;
+            if (end != m_pos) {
+                std::memmove(m_in.data() + end, m_in.data() + m_pos, m_filled - m_pos);
+                m_filled -= m_pos - end;
+                m_pos = end;
+            }
+            keep = m_message_start;
+        }
+        m_in.erase(0, keep);
+        m_in.resize(m_filled - keep);
+        m_filled -= keep;
+        m_pos -= keep;
+        if (m_assembling) {
+            m_message_start = 0;
+        }
+    }
+
+    std::shared_ptr<const websocket_callbacks> m_callbacks;
+#ifdef RESTPP_WITH_ZLIB
+    std::unique_ptr<websocket_deflate> m_deflate;
+#endif
+    std::string m_scratch;
+    std::string m_in;
+    size_t m_filled{0};
+    size_t m_pos{0};
+    bool m_assembling{false};
+    bool m_message_compressed{false};
+    websocket_opcode m_message_opcode{websocket_opcode::text};
+    size_t m_message_start{0};
+    size_t m_message_size{0};
+    std::deque<buffer> m_out;
+    size_t m_out_offset{0};
+    bool m_close_sent{false};
+    bool m_closed{false};
+};
+
+// Encodes a message once and queues the same buffer on every connection.
+// Connections is a range of pointers, raw or smart, to websocket_connection.
+template <typename Connections>
+void websocket_broadcast(const Connections& connections, websocket_opcode opcode, std::string_view payload) {
+    auto frame = std::make_shared<std::string>();
+    websocket_frame::encode(*frame, opcode, payload);
+    websocket_connection::buffer shared = std::move(frame);
+    for (const auto& c: connections) {
+        c->send_frame(shared);
+    }
+}
+
+class websocket_handshake {
+public:
+    // Validates an upgrade request and builds the 101 response, or an error
+    // response when the request is not a valid WebSocket handshake.
+    static std::shared_ptr<response> accept(const request& r, std::shared_ptr<const websocket_callbacks> callbacks) {
+        auto upgrade = r.get_header("Upgrade");
+        auto connection = r.get_header("Connection");
+        auto key = r.get_header("Sec-WebSocket-Key");
+        if (r.method() != "GET" || !upgrade || !iequals(*upgrade, "websocket")
+            || !connection || !has_token(*connection, "upgrade") || !key || !valid_key(*key)) {
+            return std::make_shared<response>(http_code::http_400_bad_request, "Bad Request");
+        }
+        auto version = r.get_header("Sec-WebSocket-Version");
+        if (!version || *version != "13") {
+            auto res = std::make_shared<response>(http_code::http_426_upgrade_required, "Upgrade Required");
+            res->set_header("Sec-WebSocket-Version", "13");
+            return res;
+        }
+
+        websocket_deflate_params deflate;
+#ifdef RESTPP_WITH_ZLIB
+        if (callbacks->compression) {
+            if (auto offer = r.get_header("Sec-WebSocket-Extensions")) {
+                deflate = negotiate_deflate(*offer);
+            }
+        }
+#endif
+        auto res = std::make_shared<websocket_response>(std::move(callbacks), deflate);
+        res->set_header("Upgrade", "websocket");
+        res->set_header("Connection", "Upgrade");
+        res->set_header("Sec-WebSocket-Accept", accept_key(*key));
+        if (deflate.enabled) {
+            std::string ext{"permessage-deflate"};
+            if (deflate.server_no_context_takeover) {
+                ext.append("; server_no_context_takeover");
+            }
+            if (deflate.client_no_context_takeover) {
+                ext.append("; client_no_context_takeover");
+            }
+            if (deflate.server_max_window_bits != 15) {
+                ext.append("; server_max_window_bits=").append(std::to_string(deflate.server_max_window_bits));
+            }
+            res->set_header("Sec-WebSocket-Extensions", ext);
+        }
+        return res;
+    }
+
+    static std::string accept_key(std::string_view key) {
+        std::string text{key};
+        text.append("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+        return base64(sha1(text));
+    }
+
+    // Only the first permessage-deflate offer is considered.
+    static websocket_deflate_params negotiate_deflate(std::string_view offers) {
+        websocket_deflate_params params;
+        auto offer = offers.substr(0, offers.find(','));
+        auto pos = offer.find(';');
+        if (trim(offer.substr(0, pos)) != "permessage-deflate") {
+            return params;
+        }
+        params.enabled = true;
+        while (pos != std::string::npos) {
+            auto next = offer.find(';', pos + 1);
+            auto param = trim(offer.substr(pos + 1, next == std::string::npos ? next : next - pos - 1));
+            pos = next;
+            auto eq = param.find('=');
+            auto name = trim(param.substr(0, eq));
+            auto value = eq == std::string::npos ? std::string_view{} : trim(param.substr(eq + 1));
+            if (name == "server_no_context_takeover") {
+                params.server_no_context_takeover = true;
+            } else if (name == "client_no_context_takeover") {
+                params.client_no_context_takeover = true;
+            } else if (name == "server_max_window_bits") {
+                int bits = value.empty() ? 0 : std::atoi(std::string{value}.c_str());
+                // zlib cannot produce raw deflate with an 8 bit window
+                if (bits < 9 || bits > 15) {
+                    return websocket_deflate_params{};
+                }
+                params.server_max_window_bits = bits;
+            } else if (name != "client_max_window_bits") {
+                return websocket_deflate_params{};
+            }
+        }
+        return params;
+    }
+
+private:
+    static bool iequals(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    static bool has_token(std::string_view list, std::string_view token) {
+        size_t pos = 0;
+        while (pos != std::string::npos) {
+            auto next = list.find(',', pos);
+            auto item = list.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+            if (iequals(trim(item), token)) {
+                return true;
+            }
+            pos = next == std::string::npos ? next : next + 1;
+        }
+        return false;
+    }
+
+    // The key must be base64 for exactly 16 bytes: 22 digits, the last one
+    // with its 4 padding bits clear, then "==".
+    static bool valid_key(std::string_view key) {
+        static constexpr std::string_view alphabet =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        if (key.size() != 24 || key.substr(22) != "==") {
+            return false;
+        }
+        for (size_t i = 0; i < 22; ++i) {
+            auto digit = alphabet.find(key[i]);
+            if (digit == std::string_view::npos || (i == 21 && (digit & 0x0f))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string_view trim(std::string_view s) {
+        auto start = s.find_first_not_of(" \t");
+        if (start == std::string::npos) {
+            return {};
+        }
+        return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+    }
+
+    static std::array<uint8_t, 20> sha1(std::string_view text) {
+        uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+        std::string msg{text};
+        auto bits = static_cast<uint64_t>(text.size()) * 8;
+        msg.push_back(static_cast<char>(0x80));
+        while (msg.size() % 64 != 56) {
+            msg.push_back(0);
+        }
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            msg.push_back(static_cast<char>(bits >> shift));
+        }
+        auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+        for (size_t chunk = 0; chunk < msg.size(); chunk += 64) {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i) {
+                auto p = reinterpret_cast<const uint8_t*>(msg.data() + chunk + i * 4);
+                w[i] = (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+            }
+            for (int i = 16; i < 80; ++i) {
+                w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; ++i) {
+                uint32_t f, k;
+                if (i < 20) {
+                    f = (b & c) | (~b & d);
+                    k = 0x5a827999;
+                } else if (i < 40) {
+                    f = b ^ c ^ d;
+                    k = 0x6ed9eba1;
+                } else if (i < 60) {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8f1bbcdc;
+                } else {
+                    f = b ^ c ^ d;
+                    k = 0xca62c1d6;
+                }
+                auto t = rotl(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rotl(b, 30);
+                b = a;
+                a = t;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+        std::array<uint8_t, 20> digest{};
+        for (int i = 0; i < 20; ++i) {
+            digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - 8 * (i % 4)));
+        }
+        return digest;
+    }
+
+    template <size_t N>
+    static std::string base64(const std::array<uint8_t, N>& data) {
+        static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < N; i += 3) {
+            uint32_t chunk = uint32_t{data[i]} << 16;
+            if (i + 1 < N) chunk |= uint32_t{data[i + 1]} << 8;
+            if (i + 2 < N) chunk |= data[i + 2];
+            out.push_back(alphabet[(chunk >> 18) & 0x3f]);
+            out.push_back(alphabet[(chunk >> 12) & 0x3f]);
+            out.push_back(i + 1 < N ? alphabet[(chunk >> 6) & 0x3f] : '=');
+            out.push_back(i + 2 < N ? alphabet[chunk & 0x3f] : '=');
+        }
+        return out;
+    }
+};
+
+// Handler for add_resource_handler that upgrades the request to a WebSocket.
+inline std::function<std::shared_ptr<response>(std::shared_ptr<request>)>
+websocket_handler(websocket_callbacks callbacks) {
+    auto shared = std::make_shared<const websocket_callbacks>(std::move(callbacks));
+    return [shared](std::shared_ptr<request> r) {
+        return websocket_handshake::accept(*r, shared);
+    };
+}
+
+}
+
+#endif //RESTPP_WEBSOCKET_HPP
@@ -0,0 +1,497 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include "restpp/http2.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <map>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace restpp;
+using namespace std::string_view_literals;
+
+using header_list = std::vector<std::pair<std::string, std::string>>;
+
+static std::string from_hex(std::string_view hex) {
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); ) {
+        if (hex[i] == ' ') {
+            ++i;
+            continue;
+        }
+        out.push_back(static_cast<char>(std::stoi(std::string{hex.substr(i, 2)}, nullptr, 16)));
+        i += 2;
+    }
+    return out;
+}
+
+static header_list decode(hpack_decoder& decoder, std::string_view hex) {
+    header_list headers;
+    auto ok = decoder.decode(from_hex(hex), [&](std::string_view name, std::string_view value) {
+        headers.emplace_back(name, value);
+    });
+    REQUIRE(ok);
+    return headers;
+}
+
+TEST_CASE("HPACK decoding") {
+    SUBCASE("Requests without Huffman coding") {
+        hpack_decoder decoder;
+        auto headers = decode(decoder, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d");
+        REQUIRE_EQ(headers, (header_list{{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+                                         {":authority", "www.example.com"}}));
+        REQUIRE_EQ(decoder.table().size(), 57);
+
+        headers = decode(decoder, "8286 84be 5808 6e6f 2d63 6163 6865");
+        REQUIRE_EQ(headers.back(), (std::pair<std::string, std::string>{"cache-control", "no-cache"}));
+        REQUIRE_EQ(headers[3].second, "www.example.com");
+        REQUIRE_EQ(decoder.table().size(), 110);
+
+        headers = decode(decoder, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65");
+        REQUIRE_EQ(headers, (header_list{{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+                                         {":authority", "www.example.com"}, {"custom-key", "custom-value"}}));
+        REQUIRE_EQ(decoder.table().size(), 164);
+        REQUIRE_EQ(decoder.table().count(), 3);
+    }
+    SUBCASE("Requests with Huffman coding") {
+        hpack_decoder decoder;
+        decode(decoder, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff");
+        decode(decoder, "8286 84be 5886 a8eb 1064 9cbf");
+        auto headers = decode(decoder, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf");
+        REQUIRE_EQ(headers[3].second, "www.example.com");
+        REQUIRE_EQ(headers[4], (std::pair<std::string, std::string>{"custom-key", "custom-value"}));
+        REQUIRE_EQ(decoder.table().size(), 164);
+    }
+    SUBCASE("Responses evicting from the dynamic table") {
+        hpack_decoder decoder{256};
+        decode(decoder,
+               "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133"
+               "2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70"
+               "6c65 2e63 6f6d");
+        REQUIRE_EQ(decoder.table().size(), 222);
+        auto headers = decode(decoder, "4803 3330 37c1 c0bf");
+        REQUIRE_EQ(headers[0].second, "307");
+        REQUIRE_EQ(headers[3].second, "https://www.example.com");
+        REQUIRE_EQ(decoder.table().size(), 222);
+        headers = decode(decoder,
+               "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d"
+               "54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049"
+               "5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e"
+               "3d31");
+        REQUIRE_EQ(headers[0].second, "200");
+        REQUIRE_EQ(headers[1].second, "private");
+        REQUIRE_EQ(headers[2].second, "Mon, 21 Oct 2013 20:13:22 GMT");
+        REQUIRE_EQ(headers[5].second, "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1");
+        REQUIRE_EQ(decoder.table().size(), 215);
+        REQUIRE_EQ(decoder.table().count(), 3);
+    }
+    SUBCASE("Malformed blocks are rejected") {
+        hpack_decoder decoder;
+        auto ignore = [](std::string_view, std::string_view) {};
+        REQUIRE_FALSE(decoder.decode(from_hex("80"), ignore));
+        REQUIRE_FALSE(decoder.decode(from_hex("be"), ignore));
+        REQUIRE_FALSE(decoder.decode(from_hex("0f"), ignore));
+        REQUIRE_FALSE(decoder.decode(from_hex("0081 0001 61"), ignore));
+    }
+    SUBCASE("Encoder output round-trips") {
+        std::string block;
+        hpack_encoder::encode(block, ":status", "200");
+        hpack_encoder::encode(block, "content-type", "text/plain");
+        hpack_encoder::encode(block, "x-custom", std::string(200, 'a'));
+        hpack_decoder decoder;
+        header_list headers;
+        REQUIRE(decoder.decode(block, [&](auto name, auto value) { headers.emplace_back(name, value); }));
+        REQUIRE_EQ(headers, (header_list{{":status", "200"}, {"content-type", "text/plain"},
+                                         {"x-custom", std::string(200, 'a')}}));
+        REQUIRE_EQ(decoder.table().count(), 0);
+    }
+}
+
+class Greeter {
+public:
+    static std::shared_ptr<response> hello(std::shared_ptr<request> r) {
+        return std::make_shared<response>("Hello " + std::string{r->GET("name").value_or("")});
+    }
+    static std::shared_ptr<response> echo(std::shared_ptr<request> r) {
+        return std::make_shared<response>(std::string{r->get_body().value_or("")});
+    }
+    static std::shared_ptr<response> type(std::shared_ptr<request> r) {
+        return std::make_shared<response>(std::string{r->get_header("Content-Type").value_or("")});
+    }
+    static std::shared_ptr<response> keep_alive(std::shared_ptr<request>) {
+        auto res = std::make_shared<response>("kept");
+        res->set_header("Connection", "keep-alive");
+        res->set_header("Keep-Alive", "timeout=5");
+        res->set_header("Transfer-Encoding", "chunked");
+        res->set_header("X-Kept", "yes");
+        return res;
+    }
+    static std::shared_ptr<response> upgrade(std::shared_ptr<request>) {
+        auto res = std::make_shared<response>(http_code::http_101_switching_protocols, "");
+        res->set_header("Upgrade", "websocket");
+        res->set_header("Connection", "Upgrade");
+        return res;
+    }
+    static void config(endpoint& e) {
+        e.add_resource_handler("GET", "keep_alive", Greeter::keep_alive);
+        e.add_resource_handler("GET", "upgrade", Greeter::upgrade);
+        e.add_resource_handler("GET", "hello", Greeter::hello);
+        e.add_resource_handler("POST", "type", Greeter::type);
+        e.add_resource_handler("POST", "echo", Greeter::echo);
+    }
+};
+
+static std::string client_preface() {
+    std::string out{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+    h2_frame::write(out, h2_frame_type::settings, 0, 0, {});
+    return out;
+}
+
+static void write_request(std::string& out, uint32_t id, std::string_view method,
+                          std::string_view path, std::string_view body = {}) {
+    std::string block;
+    hpack_encoder::encode(block, ":method", method);
+    hpack_encoder::encode(block, ":scheme", "http");
+    hpack_encoder::encode(block, ":path", path);
+    hpack_encoder::encode(block, ":authority", "localhost");
+    uint8_t flags = h2_frame::end_headers | (body.empty() ? h2_frame::end_stream : 0);
+    h2_frame::write(out, h2_frame_type::headers, flags, id, block);
+    if (!body.empty()) {
+        h2_frame::write(out, h2_frame_type::data, h2_frame::end_stream, id, body);
+    }
+}
+
+struct h2_reply {
+    std::string status;
+    header_list headers;
+    std::string body;
+    std::optional<h2_error> reset;
+    bool done{false};
+};
+
+// Reads server frames until every expected stream has finished.
+static void read_replies(std::string_view data, std::map<uint32_t, h2_reply>& replies) {
+    hpack_decoder decoder;
+    h2_frame frame{};
+    while (h2_frame::parse(data, frame)) {
+        data.remove_prefix(h2_frame::header_size + frame.payload.size());
+        auto& r = replies[frame.stream_id];
+        if (frame.type == h2_frame_type::headers) {
+            decoder.decode(frame.payload, [&](std::string_view name, std::string_view value) {
+                if (name == ":status") {
+                    r.status = value;
+                } else {
+                    r.headers.emplace_back(name, value);
+                }
+            });
+        } else if (frame.type == h2_frame_type::data) {
+            r.body.append(frame.payload);
+        } else if (frame.type == h2_frame_type::rst_stream && frame.payload.size() == 4) {
+            r.reset = static_cast<h2_error>(h2_frame::read_u32(frame.payload));
+            continue;
+        } else {
+            continue;
+        }
+        r.done = frame.flags & h2_frame::end_stream;
+    }
+}
+
+// Error code of the GOAWAY frame in data, if there is one.
+static std::optional<h2_error> goaway_error(std::string_view data) {
+    h2_frame frame{};
+    while (h2_frame::parse(data, frame)) {
+        data.remove_prefix(h2_frame::header_size + frame.payload.size());
+        if (frame.type == h2_frame_type::goaway && frame.payload.size() >= 8) {
+            return static_cast<h2_error>(h2_frame::read_u32(frame.payload.substr(4)));
+        }
+    }
+    return std::nullopt;
+}
+
+TEST_CASE("HTTP/2 connection") {
+    endpoint e;
+    e.add_resource<Greeter>("greet");
+
+    SUBCASE("Multiplexed streams are routed through the endpoint tree") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        write_request(in, 1, "GET", "/greet/hello?name=alice");
+        write_request(in, 3, "POST", "/greet/echo", "ping");
+        write_request(in, 5, "GET", "/nowhere");
+        REQUIRE(conn.feed(in));
+
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].status, "200");
+        REQUIRE_EQ(replies[1].body, "Hello alice");
+        REQUIRE(replies[1].done);
+        REQUIRE_EQ(replies[3].body, "ping");
+        REQUIRE_EQ(replies[5].status, "404");
+        REQUIRE_EQ(conn.open_streams(), 0);
+    }
+    SUBCASE("Lowercase header names are found by their usual spelling") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "POST");
+        hpack_encoder::encode(block, ":path", "/greet/type");
+        hpack_encoder::encode(block, "content-type", "application/json");
+        h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers | h2_frame::end_stream, 1, block);
+        REQUIRE(conn.feed(in));
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "application/json");
+    }
+    SUBCASE("Connection-specific response fields are dropped") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        write_request(in, 1, "GET", "/greet/keep_alive");
+        REQUIRE(conn.feed(in));
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "kept");
+        REQUIRE_EQ(replies[1].headers, (header_list{{"content-length", "4"}, {"x-kept", "yes"}}));
+    }
+    SUBCASE("Protocol upgrades are not offered over HTTP/2") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        write_request(in, 1, "GET", "/greet/upgrade");
+        REQUIRE(conn.feed(in));
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].status, "501");
+        REQUIRE(replies[1].done);
+        for (const auto& [name, value]: replies[1].headers) {
+            REQUIRE_NE(name, "upgrade");
+        }
+    }
+    SUBCASE("Empty header values and multi-line bodies reach the handler intact") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "POST");
+        hpack_encoder::encode(block, ":path", "/greet/echo");
+        hpack_encoder::encode(block, "accept", "");
+        h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers, 1, block);
+        h2_frame::write(in, h2_frame_type::data, h2_frame::end_stream, 1, "line1\r\nline2\r\n\r\nline4");
+        REQUIRE(conn.feed(in));
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "line1\r\nline2\r\n\r\nline4");
+    }
+    SUBCASE("Malformed fields reset the stream") {
+        auto malformed = [&](std::string_view name, std::string_view value,
+                             std::string_view path = "/greet/hello") {
+            h2_connection conn{e};
+            auto in = client_preface();
+            std::string block;
+            hpack_encoder::encode(block, ":method", "GET");
+            hpack_encoder::encode(block, ":path", path);
+            if (!name.empty()) {
+                hpack_encoder::encode(block, name, value);
+            }
+            h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers | h2_frame::end_stream, 1, block);
+            write_request(in, 3, "GET", "/greet/hello?name=frank");
+            REQUIRE(conn.feed(in));
+            std::map<uint32_t, h2_reply> replies;
+            read_replies(conn.output(), replies);
+            REQUIRE_EQ(replies[3].body, "Hello frank");
+            return replies[1].reset == h2_error::protocol_error && replies[1].status.empty();
+        };
+        REQUIRE(malformed("x-foo", "a\r\nx-admin: yes"));
+        REQUIRE(malformed("x-foo", std::string_view{"a\0b", 3}));
+        REQUIRE(malformed("x-foo", " padded"));
+        REQUIRE(malformed("X-Foo", "upper"));
+        REQUIRE(malformed("x:foo", "colon"));
+        REQUIRE(malformed("connection", "keep-alive"));
+        REQUIRE(malformed(":status", "200"));
+        REQUIRE(malformed("", "", "/greet/hello HTTP/1.1\r\nx-admin: yes"));
+        REQUIRE(malformed("", "", "/greet/hello extra"));
+        REQUIRE_FALSE(malformed("te", "trailers"));
+    }
+    SUBCASE("Frames split across reads") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        write_request(in, 1, "GET", "/greet/hello?name=bob");
+        for (char c: in) {
+            REQUIRE(conn.feed(std::string_view{&c, 1}));
+        }
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "Hello bob");
+    }
+    SUBCASE("Response data respects the peer's flow control window") {
+        h2_connection conn{e};
+        std::string in{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+        std::string settings{"\x00\x04\x00\x00\x00\x04", 6};
+        h2_frame::write(in, h2_frame_type::settings, 0, 0, settings);
+        write_request(in, 1, "POST", "/greet/echo", "0123456789");
+        REQUIRE(conn.feed(in));
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "0123");
+        REQUIRE_FALSE(replies[1].done);
+
+        conn.consume_output(conn.output().size());
+        std::string update;
+        h2_frame::write_u32(update, 100);
+        std::string frame;
+        h2_frame::write(frame, h2_frame_type::window_update, 0, 1, update);
+        REQUIRE(conn.feed(frame));
+        replies.clear();
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].body, "456789");
+        REQUIRE(replies[1].done);
+    }
+    SUBCASE("Frames larger than the advertised maximum close the connection") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "POST");
+        hpack_encoder::encode(block, ":path", "/greet/echo");
+        h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers, 1, block);
+        h2_frame::write(in, h2_frame_type::data, h2_frame::end_stream, 1, std::string(16385, 'x'));
+        REQUIRE_FALSE(conn.feed(in));
+        REQUIRE_EQ(goaway_error(conn.output()), h2_error::frame_size_error);
+    }
+    SUBCASE("Endless CONTINUATION frames close the connection") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "GET");
+        h2_frame::write(in, h2_frame_type::headers, 0, 1, block);
+        for (int i = 0; i < 5; ++i) {
+            h2_frame::write(in, h2_frame_type::continuation, 0, 1, std::string(16384, 'x'));
+        }
+        REQUIRE_FALSE(conn.feed(in));
+        REQUIRE_EQ(goaway_error(conn.output()), h2_error::enhance_your_calm);
+    }
+    SUBCASE("Header lists expanding past the limit are refused") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "GET");
+        hpack_encoder::encode(block, ":path", "/greet/hello");
+        // Index one large field, then reference it over and over
+        std::string field;
+        hpack_encoder::encode(field, "x-big", std::string(3000, 'a'));
+        field[0] = '\x40';
+        block.append(field).append(25, '\xbe');
+        h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers | h2_frame::end_stream, 1, block);
+        write_request(in, 3, "GET", "/greet/hello?name=erin");
+        REQUIRE(conn.feed(in));
+
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].status, "431");
+        REQUIRE_EQ(replies[3].body, "Hello erin");
+        REQUIRE_EQ(conn.open_streams(), 0);
+    }
+    SUBCASE("Request bodies over the limit are refused") {
+        h2_connection conn{e};
+        auto in = client_preface();
+        std::string block;
+        hpack_encoder::encode(block, ":method", "POST");
+        hpack_encoder::encode(block, ":path", "/greet/echo");
+        h2_frame::write(in, h2_frame_type::headers, h2_frame::end_headers, 1, block);
+        for (int i = 0; i < 65; ++i) {
+            h2_frame::write(in, h2_frame_type::data, 0, 1, std::string(16384, 'x'));
+        }
+        REQUIRE(conn.feed(in));
+
+        std::map<uint32_t, h2_reply> replies;
+        read_replies(conn.output(), replies);
+        REQUIRE_EQ(replies[1].status, "413");
+        REQUIRE(replies[1].done);
+        REQUIRE_EQ(conn.open_streams(), 0);
+    }
+    SUBCASE("Bad preface closes the connection") {
+        h2_connection conn{e};
+        REQUIRE_FALSE(conn.feed("GET / HTTP/1.1\r\n\r\n"sv));
+        REQUIRE(conn.closed());
+    }
+}
+
+// Writes all of data, looping over short writes.
+static bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+TEST_CASE("HTTP/2 over loopback") {
+    endpoint e;
+    e.add_resource<Greeter>("greet");
+
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener >= 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    int client = ::socket(AF_INET, SOCK_STREAM, 0);
+    // Connect before the server thread exists, so a failure here cannot
+    // leave it blocked in accept or throw while it is joinable.
+    bool connected = client >= 0
+                     && ::bind(listener, reinterpret_cast<sockaddr*>(&addr), len) == 0
+                     && ::listen(listener, 1) == 0
+                     && ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len) == 0
+                     && ::connect(client, reinterpret_cast<sockaddr*>(&addr), len) == 0;
+    if (!connected) {
+        ::close(client);
+        ::close(listener);
+        FAIL("could not set up the loopback connection");
+    }
+    timeval timeout{5, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::thread server([&] {
+        int fd = ::accept(listener, nullptr, nullptr);
+        h2_connection conn{e};
+        char buffer[4096];
+        ssize_t n;
+        while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            bool open = conn.feed(std::string_view{buffer, static_cast<size_t>(n)});
+            if (!send_all(fd, conn.take_output()) || !open) {
+                break;
+            }
+        }
+        ::close(fd);
+    });
+
+    auto out = client_preface();
+    write_request(out, 1, "GET", "/greet/hello?name=carol");
+    write_request(out, 3, "GET", "/greet/hello?name=dave");
+    CHECK(send_all(client, out));
+
+    std::string received;
+    std::map<uint32_t, h2_reply> replies;
+    char buffer[4096];
+    while (!(replies[1].done && replies[3].done)) {
+        auto n = ::recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        received.append(buffer, n);
+        replies.clear();
+        read_replies(received, replies);
+    }
+    ::close(client);
+    server.join();
+    ::close(listener);
+
+    REQUIRE_EQ(replies[1].body, "Hello carol");
+    REQUIRE_EQ(replies[3].body, "Hello dave");
+}
@@ -0,0 +1,150 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include "restpp/limits.hpp"
+
+#include <cmath>
+#include <string_view>
+
+using namespace restpp;
+using namespace std::string_view_literals;
+using namespace std::chrono_literals;
+
+static std::shared_ptr<response> ok(std::shared_ptr<request>) {
+    return std::make_shared<response>("Okay");
+}
+
+TEST_CASE("Token bucket") {
+    auto t0 = token_bucket::clock::time_point{} + 1h;
+    SUBCASE("Allows a burst then refills at the configured rate") {
+        token_bucket bucket{10, 3};
+        REQUIRE(bucket.try_acquire(t0));
+        REQUIRE(bucket.try_acquire(t0));
+        REQUIRE(bucket.try_acquire(t0));
+        REQUIRE_FALSE(bucket.try_acquire(t0));
+        REQUIRE_FALSE(bucket.try_acquire(t0 + 50ms));
+        REQUIRE(bucket.try_acquire(t0 + 100ms));
+        REQUIRE_FALSE(bucket.try_acquire(t0 + 100ms));
+    }
+    SUBCASE("Is full again after being idle") {
+        token_bucket bucket{10, 2};
+        REQUIRE(bucket.try_acquire(t0));
+        REQUIRE_FALSE(bucket.full(t0));
+        REQUIRE(bucket.full(t0 + 100ms));
+    }
+}
+
+TEST_CASE("Rate limiter keeps one bucket per key") {
+    auto t0 = token_bucket::clock::time_point{} + 1h;
+    rate_limiter limiter{1, 1, 16};
+    REQUIRE(limiter.try_acquire("10.0.0.1", t0));
+    REQUIRE_FALSE(limiter.try_acquire("10.0.0.1", t0));
+    REQUIRE(limiter.try_acquire("10.0.0.2", t0));
+    REQUIRE(limiter.try_acquire("10.0.0.1", t0 + 1s));
+}
+
+TEST_CASE("Rate limiter keeps a throttled key throttled when slots collide") {
+    auto t0 = token_bucket::clock::time_point{} + 1h;
+    // With two slots some of these keys share a home slot with "B"
+    for (int i = 0; i < 16; ++i) {
+        rate_limiter limiter{1, 1, 2};
+        auto key = "A" + std::to_string(i);
+        REQUIRE(limiter.try_acquire("B", t0));
+        REQUIRE(limiter.try_acquire(key, t0 + 900ms));
+        REQUIRE_FALSE(limiter.try_acquire(key, t0 + 1s));
+        REQUIRE(limiter.try_acquire(key, t0 + 1900ms));
+    }
+}
+
+TEST_CASE("Token bucket rejects invalid rates") {
+    REQUIRE_THROWS(token_bucket(0, 1));
+    REQUIRE_THROWS(token_bucket(-1, 1));
+    REQUIRE_THROWS(token_bucket(std::nan(""), 1));
+    REQUIRE_THROWS(token_bucket(1, -1));
+    REQUIRE_NOTHROW(token_bucket(1e12, 1e12));
+}
+
+TEST_CASE("Concurrency limiter") {
+    concurrency_limiter limiter{2};
+    auto a = limiter.try_acquire();
+    auto b = limiter.try_acquire();
+    REQUIRE(a);
+    REQUIRE(b);
+    REQUIRE_FALSE(limiter.try_acquire());
+    REQUIRE_EQ(limiter.in_flight(), 2);
+    a.release();
+    REQUIRE_EQ(limiter.in_flight(), 1);
+    {
+        auto c = limiter.try_acquire();
+        REQUIRE(c);
+    }
+    REQUIRE_EQ(limiter.in_flight(), 1);
+}
+
+TEST_CASE("Admission control") {
+    endpoint e;
+    e.add_resource_handler("GET", "foo", ok);
+    e.add_resource_handler("GET", "bar", ok);
+    auto t0 = token_bucket::clock::time_point{} + 1h;
+
+    SUBCASE("Rate limited by route returns HTTP 429") {
+        admission_control control;
+        control.add_rate_limit(rate_key::route, 1, 1);
+        REQUIRE(control.admit("GET /foo?a=1 HTTP/1.1\r\n\r\n"sv, {}, t0));
+        REQUIRE_EQ(control.admit("GET /foo?a=2 HTTP/1.1\r\n\r\n"sv, {}, t0).code(),
+                   http_code::http_429_too_many_requests);
+        REQUIRE(control.admit("GET /bar HTTP/1.1\r\n\r\n"sv, {}, t0));
+    }
+    SUBCASE("Routes share a bucket however their slashes are written") {
+        admission_control control;
+        control.add_rate_limit(rate_key::route, 1, 1);
+        REQUIRE(control.admit("GET /foo/bar HTTP/1.1\r\n\r\n"sv, {}, t0));
+        REQUIRE_FALSE(control.admit("GET /foo/bar/ HTTP/1.1\r\n\r\n"sv, {}, t0));
+        REQUIRE_FALSE(control.admit("GET //foo//bar HTTP/1.1\r\n\r\n"sv, {}, t0));
+        REQUIRE_FALSE(control.admit("GET foo/bar?x=1 HTTP/1.1\r\n\r\n"sv, {}, t0));
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\n\r\n"sv, {}, t0));
+    }
+    SUBCASE("Rate limited by header") {
+        admission_control control;
+        control.add_rate_limit(rate_key::header, 1, 1, "X-Api-Key");
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\nx-api-key: one\r\n\r\n"sv, {}, t0));
+        REQUIRE_FALSE(control.admit("GET /bar HTTP/1.1\r\nX-Api-Key: one\r\n\r\n"sv, {}, t0));
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\nX-Api-Key: two\r\n\r\n"sv, {}, t0));
+    }
+    SUBCASE("Rate limited by client address") {
+        admission_control control;
+        control.add_rate_limit(rate_key::client_ip, 1, 1);
+        auto res = control.handle_request(e, "GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1");
+        REQUIRE_EQ(res->code(), http_code::http_200_ok);
+        res = control.handle_request(e, "GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1");
+        REQUIRE_EQ(res->code(), http_code::http_429_too_many_requests);
+    }
+    SUBCASE("Sheds load over the concurrency limit with HTTP 503") {
+        admission_control control{1};
+        auto first = control.admit("GET /foo HTTP/1.1\r\n\r\n"sv);
+        REQUIRE(first);
+        auto res = control.handle_request(e, "GET /foo HTTP/1.1\r\n\r\n"sv);
+        REQUIRE_EQ(res->code(), http_code::http_503_service_unavailable);
+    }
+    SUBCASE("Shed requests do not spend rate limit tokens") {
+        admission_control control{1};
+        control.add_rate_limit(rate_key::client_ip, 1, 2);
+        {
+            auto first = control.admit("GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1", t0);
+            REQUIRE(first);
+            REQUIRE_EQ(control.admit("GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1", t0).code(),
+                       http_code::http_503_service_unavailable);
+        }
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1", t0));
+        REQUIRE_EQ(control.admit("GET /foo HTTP/1.1\r\n\r\n"sv, "10.0.0.1", t0).code(),
+                   http_code::http_429_too_many_requests);
+    }
+    SUBCASE("A refusal by one limit does not charge the others") {
+        admission_control control;
+        control.add_rate_limit(rate_key::client_ip, 1, 2);
+        control.add_rate_limit(rate_key::header, 1, 1, "X-Api-Key");
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\nX-Api-Key: one\r\n\r\n"sv, "10.0.0.1", t0));
+        REQUIRE_FALSE(control.admit("GET /foo HTTP/1.1\r\nX-Api-Key: one\r\n\r\n"sv, "10.0.0.1", t0));
+        REQUIRE(control.admit("GET /foo HTTP/1.1\r\nX-Api-Key: two\r\n\r\n"sv, "10.0.0.1", t0));
+        REQUIRE_FALSE(control.admit("GET /foo HTTP/1.1\r\nX-Api-Key: three\r\n\r\n"sv, "10.0.0.1", t0));
+    }
+}
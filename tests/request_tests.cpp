@@ -67,6 +67,27 @@ TEST_CASE("Parsing HTTP Request with headers") {
         REQUIRE_EQ(req.get_header("Content-Length"), "0");
         REQUIRE_FALSE(req.get_header("Missing-Header"));
     }
+    SUBCASE("Header names are case-insensitive") {
+        auto req_text =
+                "GET / HTTP/2\r\n"
+                "content-type: text/plain\r\n"
+                "X-Request-ID: 42\r\n"
+                "\r\n"sv;
+        auto req = request{req_text};
+        REQUIRE_EQ(req.get_header("Content-Type"), "text/plain");
+        REQUIRE_EQ(req.get_header("x-request-id"), "42");
+        REQUIRE_FALSE(req.get_header("Content-Typ"));
+    }
+    SUBCASE("Empty header values") {
+        auto req_text =
+                "GET / HTTP/1.1\r\n"
+                "Accept:\r\n"
+                "X-Blank:   \r\n"
+                "\r\n"sv;
+        auto req = request{req_text};
+        REQUIRE_EQ(req.get_header("Accept"), "");
+        REQUIRE_EQ(req.get_header("X-Blank"), "");
+    }
 }
 
 
@@ -92,4 +113,15 @@ TEST_CASE("Parsing HTTP Request with body") {
         auto req = request{req_text};
         REQUIRE_EQ(req.get_body(), "This is the body content");
     }
+    SUBCASE("Body spanning several lines") {
+        auto req_text =
+                "POST /upload HTTP/1.1\r\n"
+                "Content-Length: 18\r\n"
+                "\r\n"
+                "line1\r\n"
+                "\r\n"
+                "line3\r\n"sv;
+        auto req = request{req_text};
+        REQUIRE_EQ(req.get_body(), "line1\r\n\r\nline3\r\n");
+    }
 }
@@ -0,0 +1,102 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include "restpp/timeouts.hpp"
+
+#include <vector>
+
+using namespace restpp;
+using namespace std::chrono_literals;
+
+TEST_CASE("Timing wheel") {
+    auto t0 = timing_wheel::clock::time_point{} + 1h;
+    timing_wheel wheel{1ms, t0};
+    std::vector<int> fired;
+
+    SUBCASE("Fires timers in order of expiry") {
+        wheel.schedule(t0 + 5ms, [&] { fired.push_back(5); });
+        wheel.schedule(t0 + 1ms, [&] { fired.push_back(1); });
+        wheel.schedule(t0 + 3ms, [&] { fired.push_back(3); });
+        REQUIRE_EQ(wheel.advance(t0 + 3ms), 2);
+        REQUIRE_EQ(fired, (std::vector<int>{1, 3}));
+        REQUIRE_EQ(wheel.size(), 1);
+        REQUIRE_EQ(wheel.advance(t0 + 10ms), 1);
+        REQUIRE_EQ(fired, (std::vector<int>{1, 3, 5}));
+        REQUIRE(wheel.empty());
+    }
+    SUBCASE("Cancelled timers do not fire") {
+        auto id = wheel.schedule(t0 + 2ms, [&] { fired.push_back(2); });
+        REQUIRE(wheel.cancel(id));
+        REQUIRE_FALSE(wheel.cancel(id));
+        REQUIRE_EQ(wheel.advance(t0 + 5ms), 0);
+        REQUIRE(fired.empty());
+    }
+    SUBCASE("Cascades timers from the upper levels") {
+        std::vector<int> delays{63, 64, 65, 4095, 4096, 4097, 300'000, 20'000'000};
+        for (auto d: delays) {
+            wheel.schedule(t0 + std::chrono::milliseconds{d}, [&fired, d] { fired.push_back(d); });
+        }
+        for (auto d: delays) {
+            REQUIRE_EQ(wheel.advance(t0 + std::chrono::milliseconds{d - 1}), 0);
+            REQUIRE_EQ(wheel.advance(t0 + std::chrono::milliseconds{d}), 1);
+        }
+        REQUIRE_EQ(fired, delays);
+    }
+    SUBCASE("Callbacks may reschedule") {
+        int count = 0;
+        std::function<void()> tick = [&] {
+            if (++count < 3) {
+                wheel.schedule(wheel.now() + 1ms, tick);
+            }
+        };
+        wheel.schedule(t0 + 1ms, tick);
+        wheel.advance(t0 + 1s);
+        REQUIRE_EQ(count, 3);
+    }
+}
+
+TEST_CASE("Request deadlines") {
+    auto t0 = timing_wheel::clock::time_point{} + 1h;
+    std::vector<std::pair<deadline_tracker::connection_id, http_code>> expired;
+    bool closed = false;
+    timeouts limits;
+    limits.header_read = 100ms;
+    limits.handler = 1s;
+    limits.keep_alive_idle = 5s;
+    deadline_tracker tracker{limits, [&](auto id, auto, auto res) {
+        if (res) {
+            expired.emplace_back(id, res->code());
+        } else {
+            closed = true;
+        }
+    }, 10ms, t0};
+
+    SUBCASE("Slow headers time out with HTTP 408") {
+        tracker.enter(1, deadline_phase::header_read, t0);
+        tracker.enter(1, deadline_phase::header_read, t0 + 90ms);
+        tracker.advance(t0 + 100ms);
+        REQUIRE_EQ(expired.size(), 1);
+        REQUIRE_EQ(expired[0].second, http_code::http_408_request_timeout);
+        REQUIRE_EQ(tracker.size(), 0);
+    }
+    SUBCASE("Slow handler times out with HTTP 504") {
+        tracker.enter(2, deadline_phase::header_read, t0);
+        tracker.enter(2, deadline_phase::handler, t0 + 50ms);
+        tracker.advance(t0 + 500ms);
+        REQUIRE(expired.empty());
+        tracker.advance(t0 + 1050ms);
+        REQUIRE_EQ(expired.size(), 1);
+        REQUIRE_EQ(expired[0].second, http_code::http_504_gateway_timeout);
+    }
+    SUBCASE("Idle keep-alive connections are closed") {
+        tracker.enter(3, deadline_phase::keep_alive_idle, t0);
+        tracker.advance(t0 + 5s);
+        REQUIRE(closed);
+        REQUIRE(expired.empty());
+    }
+    SUBCASE("Leaving cancels the deadline") {
+        tracker.enter(4, deadline_phase::header_read, t0);
+        tracker.leave(4);
+        tracker.advance(t0 + 1s);
+        REQUIRE(expired.empty());
+    }
+}
@@ -0,0 +1,292 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+#include "restpp/websocket.hpp"
+
+#include <string_view>
+#include <vector>
+
+using namespace restpp;
+using namespace std::string_view_literals;
+
+static const uint8_t mask_key[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+static std::string client_frame(websocket_opcode opcode, std::string_view payload,
+                                uint8_t flags = websocket_frame::fin) {
+    std::string out;
+    websocket_frame::encode(out, opcode, payload, flags, mask_key);
+    return out;
+}
+
+static std::shared_ptr<websocket_response> upgrade(endpoint& e, std::string_view extensions = {}) {
+    std::string text{"GET /chat HTTP/1.1\r\n"
+                     "Host: server.example.com\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                     "Sec-WebSocket-Version: 13\r\n"};
+    if (!extensions.empty()) {
+        text.append("Sec-WebSocket-Extensions: ").append(extensions).append("\r\n");
+    }
+    text.append("\r\n");
+    auto res = e.handle_request(std::make_shared<request>(text));
+    return std::dynamic_pointer_cast<websocket_response>(res);
+}
+
+struct recorder {
+    std::vector<std::pair<websocket_opcode, std::string>> messages;
+    websocket_status close_code{};
+    bool echo{false};
+
+    websocket_callbacks callbacks() {
+        websocket_callbacks cb;
+        cb.on_message = [this](websocket_connection& c, const websocket_message& m) {
+            messages.emplace_back(m.opcode, std::string{m.data});
+            if (echo) {
+                c.send(m.opcode, m.data);
+            }
+        };
+        cb.on_close = [this](websocket_connection&, websocket_status code, std::string_view) {
+            close_code = code;
+        };
+        return cb;
+    }
+};
+
+TEST_CASE("WebSocket masking") {
+    for (size_t size: {0, 1, 3, 15, 16, 17, 64, 1000}) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<char>(i * 7);
+        }
+        auto masked = data;
+        websocket_mask(masked.data(), masked.size(), mask_key);
+        for (size_t i = 0; i < size; ++i) {
+            REQUIRE_EQ(static_cast<uint8_t>(masked[i]), static_cast<uint8_t>(data[i] ^ mask_key[i % 4]));
+        }
+        websocket_mask(masked.data(), masked.size(), mask_key);
+        REQUIRE_EQ(masked, data);
+    }
+}
+
+TEST_CASE("WebSocket handshake") {
+    recorder r;
+    endpoint e;
+    e.add_resource_handler("GET", "chat", websocket_handler(r.callbacks()));
+
+    SUBCASE("Upgrade is accepted") {
+        auto res = upgrade(e);
+        REQUIRE(res);
+        REQUIRE_EQ(res->code(), http_code::http_101_switching_protocols);
+        auto handshake = res->handshake();
+        REQUIRE_NE(handshake.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"), std::string::npos);
+        REQUIRE_EQ(handshake.find("Sec-WebSocket-Extensions"), std::string::npos);
+    }
+    SUBCASE("Plain requests are rejected") {
+        auto res = e.handle_request(std::make_shared<request>("GET /chat HTTP/1.1\r\n\r\n"sv));
+        REQUIRE_EQ(res->code(), http_code::http_400_bad_request);
+    }
+    SUBCASE("Unsupported versions ask for an upgrade") {
+        auto res = e.handle_request(std::make_shared<request>(
+                "GET /chat HTTP/1.1\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                "Sec-WebSocket-Version: 8\r\n"
+                "\r\n"sv));
+        REQUIRE_EQ(res->code(), http_code::http_426_upgrade_required);
+    }
+    SUBCASE("Connection must carry the upgrade token") {
+        auto handshake = [&](std::string_view connection) {
+            std::string text{"GET /chat HTTP/1.1\r\n"
+                             "Upgrade: websocket\r\n"
+                             "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                             "Sec-WebSocket-Version: 13\r\n"};
+            if (!connection.empty()) {
+                text.append("Connection: ").append(connection).append("\r\n");
+            }
+            text.append("\r\n");
+            return e.handle_request(std::make_shared<request>(text))->code();
+        };
+        REQUIRE_EQ(handshake("keep-alive, Upgrade"), http_code::http_101_switching_protocols);
+        REQUIRE_EQ(handshake("keep-alive"), http_code::http_400_bad_request);
+        REQUIRE_EQ(handshake(""), http_code::http_400_bad_request);
+    }
+    SUBCASE("Keys must encode 16 bytes") {
+        auto handshake = [&](std::string_view key) {
+            std::string text{"GET /chat HTTP/1.1\r\n"
+                             "Upgrade: websocket\r\n"
+                             "Connection: Upgrade\r\n"
+                             "Sec-WebSocket-Version: 13\r\n"
+                             "Sec-WebSocket-Key: "};
+            text.append(key).append("\r\n\r\n");
+            return e.handle_request(std::make_shared<request>(text))->code();
+        };
+        REQUIRE_EQ(handshake("AAAAAAAAAAAAAAAAAAAAAA=="), http_code::http_101_switching_protocols);
+        REQUIRE_EQ(handshake("dGhlIHNhbXBsZSBub25jZQ="), http_code::http_400_bad_request);
+        REQUIRE_EQ(handshake("dGhlIHNhbXBsZSBub25jZ*=="), http_code::http_400_bad_request);
+        REQUIRE_EQ(handshake("dGhlIHNhbXBsZSBub25jZR=="), http_code::http_400_bad_request);
+        REQUIRE_EQ(handshake("dGhlIHNhbXBsZSBub25jZQ"), http_code::http_400_bad_request);
+    }
+}
+
+TEST_CASE("UTF-8 validation") {
+    REQUIRE(websocket_valid_utf8(""));
+    REQUIRE(websocket_valid_utf8("plain ascii that spans more than eight bytes"));
+    REQUIRE(websocket_valid_utf8("\xce\xba\xe1\xbd\xb9\xcf\x83\xce\xbc\xce\xb5"));
+    REQUIRE(websocket_valid_utf8("\xf4\x8f\xbf\xbf"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xc0\xaf"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xe0\x80\xaf"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xed\xa0\x80"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xf4\x90\x80\x80"));
+    REQUIRE_FALSE(websocket_valid_utf8("abcdefgh\xce"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xe2\x82"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xe2\x28\xa1"));
+    REQUIRE_FALSE(websocket_valid_utf8("\xff"));
+}
+
+TEST_CASE("WebSocket frames") {
+    recorder r;
+    endpoint e;
+    e.add_resource_handler("GET", "chat", websocket_handler(r.callbacks()));
+    auto res = upgrade(e);
+    REQUIRE(res);
+    websocket_connection conn{*res};
+
+    SUBCASE("Masked text frame") {
+        auto frame = "\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58"sv;
+        REQUIRE(conn.feed(frame));
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_EQ(r.messages[0].second, "Hello");
+        REQUIRE_EQ(r.messages[0].first, websocket_opcode::text);
+    }
+    SUBCASE("Fragmented message with an interleaved ping") {
+        auto in = client_frame(websocket_opcode::text, "Hel", 0);
+        in += client_frame(websocket_opcode::ping, "are you there");
+        in += client_frame(websocket_opcode::continuation, "lo, ", 0);
+        in += client_frame(websocket_opcode::continuation, "world");
+        for (char c: in) {
+            REQUIRE(conn.feed(std::string_view{&c, 1}));
+        }
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_EQ(r.messages[0].second, "Hello, world");
+        REQUIRE_EQ(conn.take_output(), "\x8a\x0d" "are you there");
+    }
+    SUBCASE("Frames interleaved with a fragmented message are not kept") {
+        REQUIRE(conn.feed(client_frame(websocket_opcode::text, "abc", 0)));
+        std::string pings;
+        for (int i = 0; i < 1000; ++i) {
+            pings += client_frame(websocket_opcode::ping, {});
+            pings += client_frame(websocket_opcode::continuation, {}, 0);
+        }
+        for (int i = 0; i < 200; ++i) {
+            REQUIRE(conn.feed(pings));
+            REQUIRE_EQ(conn.buffered(), 3);
+            conn.take_output();
+        }
+        REQUIRE(conn.feed(client_frame(websocket_opcode::continuation, "def")));
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_EQ(r.messages[0].second, "abcdef");
+        REQUIRE_EQ(conn.buffered(), 0);
+    }
+    SUBCASE("Large binary message") {
+        std::string payload(70000, 'x');
+        REQUIRE(conn.feed(client_frame(websocket_opcode::binary, payload)));
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_EQ(r.messages[0].second, payload);
+    }
+    SUBCASE("Close is echoed") {
+        REQUIRE_FALSE(conn.feed(client_frame(websocket_opcode::close, "\x03\xe8"sv)));
+        REQUIRE(conn.closed());
+        REQUIRE_EQ(r.close_code, websocket_status::normal_closure);
+        REQUIRE_EQ(conn.take_output(), "\x88\x02\x03\xe8"sv);
+    }
+    SUBCASE("Close codes reserved for local use are a protocol error") {
+        REQUIRE_FALSE(conn.feed(client_frame(websocket_opcode::close, "\x03\xed"sv)));
+        REQUIRE_EQ(r.close_code, websocket_status::protocol_error);
+        REQUIRE_EQ(conn.take_output(), "\x88\x02\x03\xea"sv);
+    }
+    SUBCASE("Application close codes are echoed") {
+        REQUIRE_FALSE(conn.feed(client_frame(websocket_opcode::close, "\x0f\xa0"sv)));
+        REQUIRE_EQ(static_cast<int>(r.close_code), 4000);
+        REQUIRE_EQ(conn.take_output(), "\x88\x02\x0f\xa0"sv);
+    }
+    SUBCASE("Text messages must be valid UTF-8") {
+        REQUIRE(conn.feed(client_frame(websocket_opcode::text, "\xce\xba\xe1\xbd", 0)));
+        REQUIRE(conn.feed(client_frame(websocket_opcode::continuation, "\xb9\xcf\x83")));
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_FALSE(conn.feed(client_frame(websocket_opcode::text, "\xed\xa0\x80")));
+        REQUIRE_EQ(r.messages.size(), 1);
+        REQUIRE_EQ(r.close_code, websocket_status::invalid_payload);
+    }
+    SUBCASE("Unmasked frames are a protocol error") {
+        REQUIRE_FALSE(conn.feed("\x81\x05Hello"sv));
+        REQUIRE_EQ(r.close_code, websocket_status::protocol_error);
+    }
+    SUBCASE("Responses are sent unmasked") {
+        r.echo = true;
+        REQUIRE(conn.feed(client_frame(websocket_opcode::text, "ping")));
+        REQUIRE_EQ(conn.take_output(), "\x81\x04ping"sv);
+    }
+}
+
+TEST_CASE("WebSocket broadcast shares one frame") {
+    recorder r;
+    endpoint e;
+    e.add_resource_handler("GET", "chat", websocket_handler(r.callbacks()));
+    auto res = upgrade(e);
+    std::vector<std::unique_ptr<websocket_connection>> connections;
+    for (int i = 0; i < 3; ++i) {
+        connections.push_back(std::make_unique<websocket_connection>(*res));
+    }
+    websocket_broadcast(connections, websocket_opcode::text, "news");
+    auto first = connections[0]->output();
+    REQUIRE_EQ(first.size(), 1);
+    REQUIRE_EQ(first[0], "\x81\x04news"sv);
+    for (auto& c: connections) {
+        REQUIRE_EQ(c->output()[0].data(), first[0].data());
+    }
+    connections[0]->consume_output(2);
+    REQUIRE_EQ(connections[0]->output()[0], "news");
+    REQUIRE_EQ(connections[1]->take_output(), "\x81\x04news"sv);
+}
+
+#ifdef RESTPP_WITH_ZLIB
+TEST_CASE("WebSocket per-message compression") {
+    recorder r;
+    endpoint e;
+    e.add_resource_handler("GET", "chat", websocket_handler(r.callbacks()));
+
+    SUBCASE("Negotiation") {
+        auto res = upgrade(e, "permessage-deflate; client_max_window_bits");
+        REQUIRE_NE(res->handshake().find("Sec-WebSocket-Extensions: permessage-deflate\r\n"), std::string::npos);
+        res = upgrade(e, "permessage-deflate; server_max_window_bits=10; server_no_context_takeover");
+        REQUIRE_NE(res->handshake().find("server_max_window_bits=10"), std::string::npos);
+        res = upgrade(e, "x-webkit-deflate-frame");
+        REQUIRE_FALSE(websocket_connection{*res}.compressed());
+    }
+    SUBCASE("Compressed messages round-trip") {
+        auto res = upgrade(e, "permessage-deflate");
+        websocket_connection conn{*res};
+        REQUIRE(conn.compressed());
+        // RFC 7692 section 7.2.3.1: "Hello" compressed
+        auto hello = client_frame(websocket_opcode::text, "\xf2\x48\xcd\xc9\xc9\x07\x00"sv,
+                                  websocket_frame::fin | websocket_frame::rsv1);
+        REQUIRE(conn.feed(hello));
+        REQUIRE(conn.feed(hello));
+        REQUIRE_EQ(r.messages.size(), 2);
+        REQUIRE_EQ(r.messages[1].second, "Hello");
+
+        std::string text(1000, 'a');
+        conn.send_text(text);
+        auto out = conn.take_output();
+        REQUIRE_EQ(static_cast<uint8_t>(out[0]), 0xc1);
+        REQUIRE_LT(out.size(), 100);
+
+        // Feed our own compressed output back as a client frame
+        std::string compressed = out.substr(2, static_cast<uint8_t>(out[1]));
+        REQUIRE(conn.feed(client_frame(websocket_opcode::text, compressed,
+                                       websocket_frame::fin | websocket_frame::rsv1)));
+        REQUIRE_EQ(r.messages.back().second, text);
+    }
+}
+#endif